@@ -0,0 +1,63 @@
+#include <iostream>
+#include <cassert>
+#include <string>
+
+#include "model.h"
+#include "utils.h"
+
+static constexpr size_t bucket_sizes[] = {1UL << 18, 1UL << 20, 1UL << 22, 1UL << 24, 1UL << 26};
+static constexpr float sparsities[] = {0.0, 0.90, 0.99};
+
+static constexpr uint32_t block_size = 64;
+static constexpr uint32_t bf_width = 16;
+static constexpr uint32_t num_workers = 4;
+
+// Transformer-like model: hidden size and number of layers
+static constexpr size_t hidden = 256;
+static constexpr size_t num_layers = 24;
+static constexpr size_t vocab = 32768;
+
+// Backward compute cost per gradient element, in ns
+static constexpr double backward_cost = 0.5;
+
+static void add(Model& m, const std::string& name, size_t size) {
+    m.add_tensor(name, size, static_cast<timedelta_t>(backward_cost * size));
+}
+
+static Model make_model() {
+    Model m;
+    add(m, "embedding", vocab * hidden);
+    for (size_t i = 0; i != num_layers; ++i) {
+        std::string layer = "layer" + std::to_string(i) + ".";
+        add(m, layer + "qkv", 3 * hidden * hidden);
+        add(m, layer + "proj", hidden * hidden);
+        add(m, layer + "norm", 2 * hidden);
+        add(m, layer + "fc1", 4 * hidden * hidden);
+        add(m, layer + "fc2", 4 * hidden * hidden);
+    }
+    return m;
+}
+
+int main() {
+#if defined(DEBUGGING) || defined(VERBOSE)
+    std::cerr << "Warning: it is recommended to run this experiment "
+                 "without D=1 and without V=1" << std::endl;
+#endif
+    Model m = make_model();
+    std::cout << "bucketsize,sparsity,buckets,compute,communication,time,exposed" << std::endl;
+
+    for (uint32_t i = 0; i != sizeof(bucket_sizes) / sizeof(size_t); ++i) {
+        for (uint32_t j = 0; j != sizeof(sparsities) / sizeof(float); ++j) {
+            BucketedSimulator s(m, bucket_sizes[i], num_workers, block_size, bf_width);
+            s.set_sparsity(sparsities[j]);
+            s.run();
+            std::cout << bucket_sizes[i] << ","
+                      << sparsities[j] << ","
+                      << s.buckets().size() << ","
+                      << float(s.get_compute_time()) / 1e6 << ","
+                      << float(s.get_communication_time()) / 1e6 << ","
+                      << float(s.get_time()) / 1e6 << ","
+                      << float(s.get_exposed_time()) / 1e6 << std::endl;
+        }
+    }
+}
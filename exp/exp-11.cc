@@ -0,0 +1,57 @@
+#include <iostream>
+#include <cassert>
+#include <string>
+
+#include "simulator.h"
+#include "pattern.h"
+#include "utils.h"
+
+static constexpr uint32_t block_size = 64;
+static constexpr uint32_t bf_width = 16;
+static constexpr float sparsities[] = {0.60, 0.90, 0.99};
+static constexpr float correlations[] = {0.0, 0.5, 0.9, 1.0};
+static constexpr const char* patterns[] = {"uniform", "zipf", "bursty"};
+
+static constexpr uint32_t num_workers = 8;
+
+static constexpr size_t data_size = 1UL << 25;
+
+static constexpr double zipf_exponent = 1.0;
+static constexpr double burst_length = 16.0;
+
+static constexpr uint32_t seed = 42;
+
+int main() {
+#if defined(DEBUGGING) || defined(VERBOSE)
+    std::cerr << "Warning: it is recommended to run this experiment "
+                 "without D=1 and without V=1" << std::endl;
+#endif
+    std::cout << "pattern,sparsity,correlation,rounds,participation,time" << std::endl;
+
+    for (uint32_t i = 0; i != sizeof(patterns) / sizeof(const char*); ++i) {
+        for (uint32_t j = 0; j != sizeof(sparsities) / sizeof(float); ++j) {
+            for (uint32_t k = 0; k != sizeof(correlations) / sizeof(float); ++k) {
+                UniformPattern uniform(sparsities[j]);
+                ZipfPattern zipf(sparsities[j], zipf_exponent, seed);
+                BurstyPattern bursty(sparsities[j], burst_length);
+                SparsityPattern& base = (std::string(patterns[i]) == "zipf")
+                    ? static_cast<SparsityPattern&>(zipf)
+                    : (std::string(patterns[i]) == "bursty")
+                        ? static_cast<SparsityPattern&>(bursty)
+                        : static_cast<SparsityPattern&>(uniform);
+                CorrelatedPattern pattern(base, correlations[k], seed);
+
+                Simulator s(num_workers, block_size, bf_width);
+                s.seed(seed);
+                s.generate_data(data_size, block_size, pattern);
+                s.run();
+                std::cout << patterns[i] << ","
+                          << sparsities[j] << ","
+                          << correlations[k] << ","
+                          << s.get_rounds() << ","
+                          << s.get_mean_participation() << ","
+                          << float(s.get_time()) / 1e6 << std::endl;
+            }
+        }
+    }
+}
@@ -0,0 +1,54 @@
+#include <iostream>
+#include <cstdlib>
+#include <chrono>
+
+#include "simulator.h"
+#include "utils.h"
+
+static constexpr uint32_t block_size = 64;
+static constexpr uint32_t bf_width = 16;
+static constexpr float sparsity = 0.90;
+
+static constexpr uint32_t nums_workers[] = {256, 1024, 4096};
+static constexpr uint32_t nums_threads[] = {2, 4, 8, 16};
+
+static constexpr size_t data_size = 1UL << 16;
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+#if defined(DEBUGGING) || defined(VERBOSE)
+    std::cerr << "Warning: it is recommended to run this experiment "
+                 "without D=1 and without V=1" << std::endl;
+#endif
+    std::cout << "num_workers,threads,time,sequential_wall,parallel_wall" << std::endl;
+
+    for (uint32_t i = 0; i != sizeof(nums_workers) / sizeof(uint32_t); ++i) {
+        Simulator base(nums_workers[i], block_size, bf_width);
+        base.generate_data(data_size, block_size, sparsity);
+
+        Simulator s = base;
+        auto start = std::chrono::steady_clock::now();
+        s.run();
+        double sequential_wall = seconds_since(start);
+
+        for (uint32_t j = 0; j != sizeof(nums_threads) / sizeof(uint32_t); ++j) {
+            Simulator p = base;
+            start = std::chrono::steady_clock::now();
+            p.run_parallel(nums_threads[j]);
+            double parallel_wall = seconds_since(start);
+            // The parallel simulation must match the sequential one
+            if (p.get_time() != s.get_time()) {
+                std::cout << "FAIL" << std::endl;
+                std::exit(1);
+            }
+            std::cout << nums_workers[i] << ","
+                      << nums_threads[j] << ","
+                      << float(p.get_time()) / 1e6 << ","
+                      << sequential_wall << ","
+                      << parallel_wall << std::endl;
+        }
+    }
+}
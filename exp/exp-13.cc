@@ -0,0 +1,74 @@
+#include <iostream>
+#include <cassert>
+#include <string>
+#include <vector>
+
+#include "multijob.h"
+#include "simulator.h"
+#include "utils.h"
+
+// Jobs sharing the aggregator: {workers, block size, width, data size, sparsity}
+struct JobConfig {
+    uint32_t num_workers;
+    uint32_t block_size;
+    uint32_t bf_width;
+    size_t data_size;
+    float sparsity;
+};
+
+static const JobConfig configs[] = {
+    {8, 64, 16, 1UL << 22, 0.90},
+    {4, 256, 8, 1UL << 22, 0.99},
+    {16, 32, 32, 1UL << 21, 0.60},
+};
+
+static const std::vector<double> weights = {1.0, 2.0, 4.0};
+
+static constexpr const char* policies[] = {"fifo", "rr", "wfq"};
+
+static constexpr uint32_t seed = 42;
+
+int main() {
+#if defined(DEBUGGING) || defined(VERBOSE)
+    std::cerr << "Warning: it is recommended to run this experiment "
+                 "without D=1 and without V=1" << std::endl;
+#endif
+    std::vector<Simulator<>> jobs;
+    for (const JobConfig& c : configs) {
+        Simulator s(c.num_workers, c.block_size, c.bf_width);
+        s.seed(seed);
+        s.generate_data(c.data_size, c.block_size, c.sparsity);
+        jobs.push_back(s);
+    }
+
+    std::cout << "policy,job,completion,solo,slowdown" << std::endl;
+    for (uint32_t i = 0; i != sizeof(policies) / sizeof(const char*); ++i) {
+        const std::string name = policies[i];
+        FifoPolicy fifo_compute, fifo_link;
+        RoundRobinPolicy rr_compute, rr_link;
+        WeightedFairPolicy wfq_compute(weights), wfq_link(weights);
+        SchedulingPolicy& compute = (name == "rr")
+            ? static_cast<SchedulingPolicy&>(rr_compute)
+            : (name == "wfq")
+                ? static_cast<SchedulingPolicy&>(wfq_compute)
+                : static_cast<SchedulingPolicy&>(fifo_compute);
+        SchedulingPolicy& link = (name == "rr")
+            ? static_cast<SchedulingPolicy&>(rr_link)
+            : (name == "wfq")
+                ? static_cast<SchedulingPolicy&>(wfq_link)
+                : static_cast<SchedulingPolicy&>(fifo_link);
+
+        MultiJobSimulator m(compute, link);
+        for (const Simulator<>& s : jobs) {
+            m.add_job(s);
+        }
+        m.run();
+        for (jobnum_t j = 0; j != jobs.size(); ++j) {
+            std::cout << name << ","
+                      << j << ","
+                      << float(m.get_completion_time(j)) / 1e6 << ","
+                      << float(m.get_solo_time(j)) / 1e6 << ","
+                      << m.get_slowdown(j) << std::endl;
+        }
+    }
+}
@@ -0,0 +1,39 @@
+#include <iostream>
+#include <cassert>
+
+#include "simulator.h"
+#include "utils.h"
+
+static constexpr uint32_t block_size = 64;
+static constexpr uint32_t bf_width = 16;
+static constexpr float sparsities[] = {0.0, 0.60, 0.90, 0.99};
+
+static constexpr uint32_t nums_workers[] = {2, 4, 8};
+
+static constexpr Collective collectives[] = {ALLREDUCE, REDUCE_SCATTER, ALL_GATHER, BROADCAST};
+static constexpr const char* names[] = {"allreduce", "reduce-scatter", "all-gather", "broadcast"};
+
+static constexpr size_t data_size = 1UL << 25;
+
+int main() {
+#if defined(DEBUGGING) || defined(VERBOSE)
+    std::cerr << "Warning: it is recommended to run this experiment "
+                 "without D=1 and without V=1" << std::endl;
+#endif
+    std::cout << "collective,num_workers,sparsity,rounds,time" << std::endl;
+
+    for (uint32_t c = 0; c != sizeof(collectives) / sizeof(Collective); ++c) {
+        for (uint32_t i = 0; i != sizeof(nums_workers) / sizeof(uint32_t); ++i) {
+            for (uint32_t j = 0; j != sizeof(sparsities) / sizeof(float); ++j) {
+                Simulator s(nums_workers[i], block_size, bf_width, collectives[c]);
+                s.generate_data(data_size, block_size, sparsities[j]);
+                s.run();
+                std::cout << names[collectives[c]] << ","
+                          << nums_workers[i] << ","
+                          << sparsities[j] << ","
+                          << s.get_rounds() << ","
+                          << float(s.get_time()) / 1e6 << std::endl;
+            }
+        }
+    }
+}
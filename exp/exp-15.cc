@@ -0,0 +1,43 @@
+#include <iostream>
+#include <cassert>
+
+#include "simulator.h"
+#include "utils.h"
+
+static constexpr uint32_t block_size = 64;
+static constexpr uint32_t bf_width = 16;
+static constexpr float sparsities[] = {0.0, 0.60, 0.90, 0.99};
+
+static constexpr uint32_t num_workers = 8;
+
+static constexpr size_t data_size = 1UL << 25;
+
+static constexpr uint32_t seed = 42;
+
+// Run the sparsity sweep with gradients of type T
+template <typename T>
+void sweep(const char* type) {
+    for (uint32_t i = 0; i != sizeof(sparsities) / sizeof(float); ++i) {
+        Simulator<T> s(num_workers, block_size, bf_width);
+        s.seed(seed);
+        s.generate_data(data_size, block_size, sparsities[i]);
+        s.run();
+        std::cout << type << ","
+                  << sparsities[i] << ","
+                  << s.get_rounds() << ","
+                  << float(s.get_time()) / 1e6 << std::endl;
+    }
+}
+
+int main() {
+#if defined(DEBUGGING) || defined(VERBOSE)
+    std::cerr << "Warning: it is recommended to run this experiment "
+                 "without D=1 and without V=1" << std::endl;
+#endif
+    std::cout << "type,sparsity,rounds,time" << std::endl;
+
+    sweep<float>("float");
+    sweep<double>("double");
+    sweep<bf16>("bf16");
+    sweep<int32_t>("int32");
+}
@@ -0,0 +1,71 @@
+#include <iostream>
+#include <cstdlib>
+#include <chrono>
+#include <vector>
+
+#include "kernels.h"
+#include "utils.h"
+
+static constexpr uint32_t block_sizes[] = {8, 16, 32, 64, 128, 256, 512, 1024,
+                                           2048, 4096, 8192, 16384};
+
+// Elements processed by each kernel, per block size and variant
+static constexpr size_t work = 1UL << 28;
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Nanoseconds per element of copy, accumulate and the zero check
+// on a zero block, which has to look at every element
+static void measure(const BlockKernels<float>& kernels, uint32_t block_size, double (&ns)[3]) {
+    const size_t reps = work / block_size;
+    std::vector<float> src(block_size, 0.0f);
+    std::vector<float> dst(block_size, 0.0f);
+    bool zero = true;
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r != reps; ++r) {
+        kernels.copy_(dst.data(), src.data(), block_size);
+    }
+    ns[0] = seconds_since(start) * 1e9 / work;
+
+    start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r != reps; ++r) {
+        kernels.accumulate_(dst.data(), src.data(), block_size);
+    }
+    ns[1] = seconds_since(start) * 1e9 / work;
+
+    start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r != reps; ++r) {
+        zero &= kernels.is_zero_(dst.data(), block_size);
+    }
+    ns[2] = seconds_since(start) * 1e9 / work;
+    if (!zero) {
+        std::cout << "FAIL" << std::endl;
+        std::exit(1);
+    }
+}
+
+int main() {
+#if defined(DEBUGGING) || defined(VERBOSE)
+    std::cerr << "Warning: it is recommended to run this experiment "
+                 "without D=1 and without V=1" << std::endl;
+#endif
+    std::cout << "block_size,kernel,generic_ns,specialized_ns,speedup" << std::endl;
+
+    static constexpr const char* names[] = {"copy", "accumulate", "is_zero"};
+    for (uint32_t i = 0; i != sizeof(block_sizes) / sizeof(uint32_t); ++i) {
+        double generic[3];
+        double specialized[3];
+        measure(BlockKernels<float>::generic(), block_sizes[i], generic);
+        measure(BlockKernels<float>::select(block_sizes[i]), block_sizes[i], specialized);
+        for (uint32_t k = 0; k != 3; ++k) {
+            std::cout << block_sizes[i] << ","
+                      << names[k] << ","
+                      << generic[k] << ","
+                      << specialized[k] << ","
+                      << generic[k] / specialized[k] << std::endl;
+        }
+    }
+}
@@ -0,0 +1,73 @@
+#include <iostream>
+#include <cstdlib>
+#include <chrono>
+#include <vector>
+
+#include "simulator.h"
+#include "utils.h"
+
+static constexpr uint32_t block_size = 64;
+static constexpr uint32_t bf_width = 16;
+static constexpr float sparsities[] = {0.90, 0.99, 0.999};
+
+static constexpr uint32_t num_workers = 8;
+
+static constexpr size_t data_size = 1UL << 25;
+
+static constexpr uint32_t seed = 42;
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+#if defined(DEBUGGING) || defined(VERBOSE)
+    std::cerr << "Warning: it is recommended to run this experiment "
+                 "without D=1 and without V=1" << std::endl;
+#endif
+    std::cout << "sparsity,time,dense_wall,sparse_ingest_wall,sparse_wall" << std::endl;
+
+    for (uint32_t i = 0; i != sizeof(sparsities) / sizeof(float); ++i) {
+        Simulator s(num_workers, block_size, bf_width);
+        s.seed(seed);
+        s.generate_data(data_size, block_size, sparsities[i]);
+
+        // The same gradients as (index, value) lists
+        std::vector<std::vector<uint64_t>> indices(num_workers);
+        std::vector<std::vector<float>> values(num_workers);
+        for (workernum_t w = 0; w != num_workers; ++w) {
+            const Buffer<float>& g = s.gradients(w);
+            for (size_t k = 0; k != g.size(); ++k) {
+                if (g[k] != 0) {
+                    indices[w].push_back(k);
+                    values[w].push_back(g[k]);
+                }
+            }
+        }
+
+        Simulator p(num_workers, block_size, bf_width);
+        auto start = std::chrono::steady_clock::now();
+        for (workernum_t w = 0; w != num_workers; ++w) {
+            p.set_sparse_data(w, data_size, indices[w], values[w]);
+        }
+        const double ingest_wall = seconds_since(start);
+
+        start = std::chrono::steady_clock::now();
+        s.run();
+        const double dense_wall = seconds_since(start);
+
+        start = std::chrono::steady_clock::now();
+        p.run();
+        const double sparse_wall = seconds_since(start);
+        if (p.get_time() != s.get_time()) {
+            std::cout << "FAIL" << std::endl;
+            std::exit(1);
+        }
+
+        std::cout << sparsities[i] << ","
+                  << float(s.get_time()) / 1e6 << ","
+                  << dense_wall << ","
+                  << ingest_wall << ","
+                  << sparse_wall << std::endl;
+    }
+}
@@ -0,0 +1,46 @@
+#include <iostream>
+#include <vector>
+
+#include "simulator.h"
+#include "utils.h"
+
+static constexpr uint32_t block_size = 64;
+static constexpr uint32_t bf_width = 16;
+static constexpr float sparsity = 0.5;
+
+static constexpr uint32_t num_workers = 8;
+
+static constexpr size_t data_size = 1UL << 22;
+
+// Fraction of each worker's blocks kept by top-k sparsification
+static constexpr double fractions[] = {1.0, 0.1, 0.01, 0.001};
+
+static constexpr uint32_t iterations = 5;
+
+static constexpr uint32_t seed = 42;
+
+int main() {
+#if defined(DEBUGGING) || defined(VERBOSE)
+    std::cerr << "Warning: it is recommended to run this experiment "
+                 "without D=1 and without V=1" << std::endl;
+#endif
+    std::cout << "fraction,iteration,time,rounds,blocks" << std::endl;
+
+    for (uint32_t i = 0; i != sizeof(fractions) / sizeof(double); ++i) {
+        const size_t k = static_cast<size_t>(fractions[i] * (data_size / block_size));
+        Simulator s(num_workers, block_size, bf_width);
+        s.seed(seed);
+        s.set_sparsifier(Sparsifier::top_k(k));
+        uint64_t start = 0;
+        for (uint32_t it = 0; it != iterations; ++it) {
+            s.generate_data(data_size, block_size, sparsity);
+            s.run();
+            std::cout << fractions[i] << ","
+                      << it << ","
+                      << float(s.get_time() - start) / 1e6 << ","
+                      << s.get_rounds() << ","
+                      << s.get_blocks() << std::endl;
+            start = s.get_time();
+        }
+    }
+}
@@ -0,0 +1,42 @@
+#include <iostream>
+#include <cassert>
+
+#include "simulator.h"
+#include "utils.h"
+
+static constexpr uint32_t block_size = 64;
+static constexpr uint32_t bf_width = 16;
+static constexpr float sparsities[] = {0.0, 0.60, 0.90, 0.99, 0.999};
+
+static constexpr uint32_t nums_workers[] = {2, 8};
+
+static constexpr Protocol protocols[] = {CHAINING, BITMAP};
+static constexpr const char* names[] = {"chaining", "bitmap"};
+
+static constexpr size_t data_size = 1UL << 24;
+
+static constexpr uint32_t seed = 42;
+
+int main() {
+#if defined(DEBUGGING) || defined(VERBOSE)
+    std::cerr << "Warning: it is recommended to run this experiment "
+                 "without D=1 and without V=1" << std::endl;
+#endif
+    std::cout << "protocol,num_workers,sparsity,rounds,time" << std::endl;
+
+    for (uint32_t p = 0; p != sizeof(protocols) / sizeof(Protocol); ++p) {
+        for (uint32_t i = 0; i != sizeof(nums_workers) / sizeof(uint32_t); ++i) {
+            for (uint32_t j = 0; j != sizeof(sparsities) / sizeof(float); ++j) {
+                Simulator s(nums_workers[i], block_size, bf_width, ALLREDUCE, protocols[p]);
+                s.seed(seed);
+                s.generate_data(data_size, block_size, sparsities[j]);
+                s.run();
+                std::cout << names[protocols[p]] << ","
+                          << nums_workers[i] << ","
+                          << sparsities[j] << ","
+                          << s.get_rounds() << ","
+                          << float(s.get_time()) / 1e6 << std::endl;
+            }
+        }
+    }
+}
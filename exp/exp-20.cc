@@ -0,0 +1,46 @@
+#include <iostream>
+#include <cassert>
+
+#include "simulator.h"
+#include "utils.h"
+
+static constexpr uint32_t block_size = 64;
+static constexpr uint32_t bf_width = 16;
+static constexpr float sparsities[] = {0.0, 0.90, 0.99};
+
+static constexpr uint32_t num_workers = 8;
+
+// Probability of losing a packet on each link, in each direction
+static constexpr double losses[] = {0.0, 0.0001, 0.001, 0.01};
+
+static constexpr timedelta_t timeouts[] = {5 * LINK_LATENCY, DEFAULT_TIMEOUT};
+
+static constexpr size_t data_size = 1UL << 22;
+
+static constexpr uint32_t seed = 42;
+
+int main() {
+#if defined(DEBUGGING) || defined(VERBOSE)
+    std::cerr << "Warning: it is recommended to run this experiment "
+                 "without D=1 and without V=1" << std::endl;
+#endif
+    std::cout << "sparsity,loss,timeout,time,lost,retransmissions" << std::endl;
+
+    for (uint32_t i = 0; i != sizeof(sparsities) / sizeof(float); ++i) {
+        for (uint32_t j = 0; j != sizeof(losses) / sizeof(double); ++j) {
+            for (uint32_t k = 0; k != sizeof(timeouts) / sizeof(timedelta_t); ++k) {
+                Simulator s(num_workers, block_size, bf_width);
+                s.seed(seed);
+                s.set_loss(losses[j], timeouts[k], seed);
+                s.generate_data(data_size, block_size, sparsities[i]);
+                s.run();
+                std::cout << sparsities[i] << ","
+                          << losses[j] << ","
+                          << timeouts[k] << ","
+                          << float(s.get_time()) / 1e6 << ","
+                          << s.get_lost_packets() << ","
+                          << s.get_retransmissions() << std::endl;
+            }
+        }
+    }
+}
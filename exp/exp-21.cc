@@ -0,0 +1,55 @@
+#include <iostream>
+#include <cassert>
+#include <string>
+
+#include "simulator.h"
+#include "pattern.h"
+#include "utils.h"
+
+static constexpr uint32_t block_size = 64;
+static constexpr uint32_t bf_widths[] = {16, 256};
+static constexpr float sparsities[] = {0.90, 0.99, 0.999};
+static constexpr const char* patterns[] = {"uniform", "zipf"};
+static constexpr const char* widths[] = {"full", "adaptive"};
+
+static constexpr uint32_t num_workers = 8;
+
+static constexpr size_t data_size = 1UL << 24;
+
+static constexpr double zipf_exponent = 1.0;
+
+static constexpr uint32_t seed = 42;
+
+int main() {
+#if defined(DEBUGGING) || defined(VERBOSE)
+    std::cerr << "Warning: it is recommended to run this experiment "
+                 "without D=1 and without V=1" << std::endl;
+#endif
+    std::cout << "pattern,bf_width,sparsity,width,rounds,time" << std::endl;
+
+    for (uint32_t i = 0; i != sizeof(patterns) / sizeof(const char*); ++i) {
+        for (uint32_t b = 0; b != sizeof(bf_widths) / sizeof(uint32_t); ++b) {
+            for (uint32_t j = 0; j != sizeof(sparsities) / sizeof(float); ++j) {
+                for (uint32_t k = 0; k != sizeof(widths) / sizeof(const char*); ++k) {
+                    UniformPattern uniform(sparsities[j]);
+                    ZipfPattern zipf(sparsities[j], zipf_exponent, seed);
+                    SparsityPattern& pattern = (std::string(patterns[i]) == "zipf")
+                        ? static_cast<SparsityPattern&>(zipf)
+                        : static_cast<SparsityPattern&>(uniform);
+
+                    Simulator s(num_workers, block_size, bf_widths[b]);
+                    s.set_adaptive_width(k == 1);
+                    s.seed(seed);
+                    s.generate_data(data_size, block_size, pattern);
+                    s.run();
+                    std::cout << patterns[i] << ","
+                              << bf_widths[b] << ","
+                              << sparsities[j] << ","
+                              << widths[k] << ","
+                              << s.get_rounds() << ","
+                              << float(s.get_time()) / 1e6 << std::endl;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,51 @@
+#include <iostream>
+#include <cassert>
+
+#include "simulator.h"
+#include "utils.h"
+
+static constexpr uint32_t block_sizes[] = {64, 256, 1024};
+static constexpr uint32_t bf_width = 16;
+static constexpr float sparsities[] = {0.0, 0.90, 0.99};
+
+// Zero slots is a server with unlimited memory
+static constexpr uint32_t nums_slots[] = {0, 4, 16, 64, 256};
+
+// Elements per slot, 256 bytes of floats
+static constexpr uint32_t slot_size = 64;
+
+static constexpr uint32_t num_workers = 8;
+
+static constexpr size_t data_size = 1UL << 22;
+
+static constexpr uint32_t seed = 42;
+
+int main() {
+#if defined(DEBUGGING) || defined(VERBOSE)
+    std::cerr << "Warning: it is recommended to run this experiment "
+                 "without D=1 and without V=1" << std::endl;
+#endif
+    std::cout << "block_size,sparsity,slots,rounds,rejected_blocks,time" << std::endl;
+
+    for (uint32_t i = 0; i != sizeof(block_sizes) / sizeof(uint32_t); ++i) {
+        for (uint32_t j = 0; j != sizeof(sparsities) / sizeof(float); ++j) {
+            for (uint32_t k = 0; k != sizeof(nums_slots) / sizeof(uint32_t); ++k) {
+                // A slot pool smaller than one block cannot aggregate anything
+                if (nums_slots[k] != 0 && nums_slots[k] * slot_size < block_sizes[i]) {
+                    continue;
+                }
+                Simulator s(num_workers, block_sizes[i], bf_width);
+                s.set_slot_pool(nums_slots[k], slot_size);
+                s.seed(seed);
+                s.generate_data(data_size, block_sizes[i], sparsities[j]);
+                s.run();
+                std::cout << block_sizes[i] << ","
+                          << sparsities[j] << ","
+                          << nums_slots[k] << ","
+                          << s.get_rounds() << ","
+                          << s.get_rejected_blocks() << ","
+                          << float(s.get_time()) / 1e6 << std::endl;
+            }
+        }
+    }
+}
@@ -0,0 +1,56 @@
+#include <iostream>
+#include <cstdlib>
+#include <chrono>
+
+#include "simulator.h"
+#include "utils.h"
+
+static constexpr uint32_t block_size = 64;
+static constexpr uint32_t bf_width = 16;
+static constexpr float sparsities[] = {0.0, 0.90, 0.99};
+
+static constexpr uint32_t nums_workers[] = {8, 64, 256};
+
+static constexpr size_t data_size = 1UL << 18;
+
+static constexpr uint32_t seed = 42;
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+#if defined(DEBUGGING) || defined(VERBOSE)
+    std::cerr << "Warning: it is recommended to run this experiment "
+                 "without D=1 and without V=1" << std::endl;
+#endif
+    std::cout << "num_workers,sparsity,time,event_wall,process_wall" << std::endl;
+
+    for (uint32_t i = 0; i != sizeof(nums_workers) / sizeof(uint32_t); ++i) {
+        for (uint32_t j = 0; j != sizeof(sparsities) / sizeof(float); ++j) {
+            Simulator base(nums_workers[i], block_size, bf_width);
+            base.seed(seed);
+            base.generate_data(data_size, block_size, sparsities[j]);
+
+            Simulator s = base;
+            auto start = std::chrono::steady_clock::now();
+            s.run();
+            double event_wall = seconds_since(start);
+
+            Simulator p = base;
+            start = std::chrono::steady_clock::now();
+            p.run_processes();
+            double process_wall = seconds_since(start);
+            // Processes must simulate exactly what events do
+            if (p.get_time() != s.get_time()) {
+                std::cout << "FAIL" << std::endl;
+                std::exit(1);
+            }
+            std::cout << nums_workers[i] << ","
+                      << sparsities[j] << ","
+                      << float(s.get_time()) / 1e6 << ","
+                      << event_wall << ","
+                      << process_wall << std::endl;
+        }
+    }
+}
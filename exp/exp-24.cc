@@ -0,0 +1,59 @@
+#include <iostream>
+#include <cstdlib>
+#include <chrono>
+
+#include "simulator.h"
+#include "utils.h"
+
+static constexpr uint32_t block_sizes[] = {1024, 16384};
+static constexpr uint32_t bf_widths[] = {64, 1024};
+static constexpr float sparsity = 0.90;
+
+static constexpr uint32_t num_workers = 4;
+
+static constexpr size_t data_size = 1UL << 24;
+
+static constexpr uint32_t seed = 42;
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+#if defined(DEBUGGING) || defined(VERBOSE)
+    std::cerr << "Warning: it is recommended to run this experiment "
+                 "without D=1 and without V=1" << std::endl;
+#endif
+    std::cout << "block_size,bf_width,threads,time,serial_wall,parallel_wall" << std::endl;
+
+    for (uint32_t i = 0; i != sizeof(block_sizes) / sizeof(uint32_t); ++i) {
+        for (uint32_t j = 0; j != sizeof(bf_widths) / sizeof(uint32_t); ++j) {
+            Simulator base(num_workers, block_sizes[i], bf_widths[j]);
+            base.seed(seed);
+            base.generate_data(data_size, block_sizes[i], sparsity);
+
+            Simulator s = base;
+            s.set_parallel_threshold(static_cast<size_t>(-1));
+            auto start = std::chrono::steady_clock::now();
+            s.run();
+            double serial_wall = seconds_since(start);
+
+            Simulator p = base;
+            p.set_parallel_threshold(DEFAULT_PARALLEL_THRESHOLD);
+            start = std::chrono::steady_clock::now();
+            p.run();
+            double parallel_wall = seconds_since(start);
+            // Column parallelism must not change the simulation
+            if (p.get_time() != s.get_time()) {
+                std::cout << "FAIL" << std::endl;
+                std::exit(1);
+            }
+            std::cout << block_sizes[i] << ","
+                      << bf_widths[j] << ","
+                      << ThreadPool::instance().size() << ","
+                      << float(s.get_time()) / 1e6 << ","
+                      << serial_wall << ","
+                      << parallel_wall << std::endl;
+        }
+    }
+}
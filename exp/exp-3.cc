@@ -1,60 +1,869 @@
 #include <iostream>
 #include <cassert>
+#include <cstdlib>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <iterator>
+#include <unistd.h>
 
 #include "simulator.h"
+#include "model.h"
+#include "pattern.h"
+#include "multijob.h"
+#include "cache.h"
+#include "process.h"
 #include "utils.h"
 
-bool isclose(float a, float b) {
-    return std::abs(a - b) <= 1e-6;
+static const char* collective_name(Collective collective) {
+    static constexpr const char* names[] = {"allreduce", "reduce-scatter", "all-gather", "broadcast"};
+    return names[collective];
 }
 
-#ifdef DEBUGGING
-void do_test(uint32_t num_workers,
-             uint32_t block_size,
-             uint32_t bf_width,
-             size_t data_sz,
-             float sparsity) {
-    std::cout << "Test params:" << std::endl;
+static const char* protocol_name(Protocol protocol) {
+    return protocol == BITMAP ? "bitmap" : "chaining";
+}
+
+// Print the parameters that all tests share, under the test's title.
+// Tests print their other parameters after these
+static void print_params(const char* title,
+                         uint32_t num_workers,
+                         uint32_t block_size,
+                         uint32_t bf_width,
+                         size_t data_sz,
+                         float sparsity) {
+    std::cout << title << " params:" << std::endl;
     std::cout << "    Number of workers: " << num_workers << std::endl;
     std::cout << "    Block size (elements): " << block_size << std::endl;
     std::cout << "    Block fusion width: " << bf_width << std::endl;
     std::cout << "    Data size (elements): " << data_sz << std::endl;
     std::cout << "    Sparsity: " << sparsity << std::endl;
+}
+
+// Run s, and a copy of it the way run sets it up and runs it, on the same
+// data, and fail unless the copy verifies and takes the same time and
+// rounds as s. Returns the copy for the test's other checks
+template <typename T, typename F>
+static Simulator<T> run_alike(Simulator<T>& s, const F& run) {
+    Simulator<T> p = s;
+    s.run();
+    run(p);
+    if (!p.verify() || p.get_time() != s.get_time() || p.get_rounds() != s.get_rounds()) {
+        std::cout << "FAIL" << std::endl;
+        std::exit(1);
+    }
+    return p;
+}
+
+void do_test(uint32_t num_workers,
+             uint32_t block_size,
+             uint32_t bf_width,
+             size_t data_sz,
+             float sparsity) {
+    print_params("Test", num_workers, block_size, bf_width, data_sz, sparsity);
+
+    Simulator s(num_workers, block_size, bf_width);
+    s.generate_data(data_sz, block_size, sparsity);
+    s.prepare_verification();
+    s.run();
+    if (!s.verify()) {
+        std::cout << "FAIL" << std::endl;
+        std::exit(1);
+    }
+#ifndef VERIFY_RESULTS
+    // New data needs a new reference
+    s.generate_data(data_sz, block_size, sparsity);
+    try {
+        s.verify();
+        std::cout << "FAIL" << std::endl;
+        std::exit(1);
+    } catch (const std::logic_error&) {
+    }
+#endif
+
+    std::cout << "PASS" << std::endl << std::endl;
+}
+
+// Run the same data through the sequential and the parallel simulator
+void do_parallel_test(uint32_t num_workers,
+                      uint32_t block_size,
+                      uint32_t bf_width,
+                      size_t data_sz,
+                      float sparsity,
+                      uint32_t num_threads) {
+    print_params("Parallel test", num_workers, block_size, bf_width, data_sz, sparsity);
+    std::cout << "    Threads: " << num_threads << std::endl;
 
     Simulator s(num_workers, block_size, bf_width);
-    s.generate_data(data_sz, sparsity);
+    s.generate_data(data_sz, block_size, sparsity);
+    s.prepare_verification();
+    run_alike(s, [num_threads](auto& p) { p.run_parallel(num_threads); });
+
+    std::cout << "PASS" << std::endl << std::endl;
+}
+
+// Run a collective other than allreduce
+void do_collective_test(Collective collective,
+                        uint32_t num_workers,
+                        uint32_t block_size,
+                        uint32_t bf_width,
+                        size_t data_sz,
+                        float sparsity) {
+    print_params("Collective test", num_workers, block_size, bf_width, data_sz, sparsity);
+    std::cout << "    Collective: " << collective_name(collective) << std::endl;
+
+    Simulator s(num_workers, block_size, bf_width, collective);
+    s.generate_data(data_sz, block_size, sparsity);
+    s.prepare_verification();
+    s.run();
+    if (!s.verify()) {
+        std::cout << "FAIL" << std::endl;
+        std::exit(1);
+    }
+
+    std::cout << "PASS" << std::endl << std::endl;
+}
+
+// Run the allreduce with a different element type
+template <typename T>
+void do_type_test(const char* type,
+                  uint32_t num_workers,
+                  uint32_t block_size,
+                  uint32_t bf_width,
+                  size_t data_sz,
+                  float sparsity) {
+    print_params("Element type test", num_workers, block_size, bf_width, data_sz, sparsity);
+    std::cout << "    Element type: " << type << std::endl;
+
+    Simulator<T> s(num_workers, block_size, bf_width);
+    s.generate_data(data_sz, block_size, sparsity);
+    s.prepare_verification();
+    s.run();
+    if (!s.verify()) {
+        std::cout << "FAIL" << std::endl;
+        std::exit(1);
+    }
 
-    std::vector<float> result;
-    result.resize(data_sz);
-    std::fill(result.begin(), result.end(), 0);
-    for (uint32_t i = 0; i != num_workers; ++i) {
-        for (size_t j = 0; j != result.size(); ++j) {
-            result[j] += s.workers_[i].gradients_[j];
+    std::cout << "PASS" << std::endl << std::endl;
+}
+
+// Give the same data to one simulator as dense gradients, and to another
+// one as sparse gradients, in COO format with shuffled entries or in CSR
+// format with rows of the given length
+void do_sparse_test(bool csr,
+                    uint32_t num_workers,
+                    uint32_t block_size,
+                    uint32_t bf_width,
+                    size_t data_sz,
+                    float sparsity,
+                    size_t row_len) {
+    print_params("Sparse input test", num_workers, block_size, bf_width, data_sz, sparsity);
+    std::cout << "    Format: " << (csr ? "CSR" : "COO") << std::endl;
+
+    Simulator s(num_workers, block_size, bf_width);
+    s.seed(1);
+    s.generate_data(data_sz, block_size, sparsity);
+    Simulator p(num_workers, block_size, bf_width);
+    std::mt19937 generator(1);
+    for (workernum_t w = 0; w != num_workers; ++w) {
+        const Buffer<float>& g = s.gradients(w);
+        std::vector<uint64_t> indices;
+        for (size_t i = 0; i != g.size(); ++i) {
+            if (g[i] != 0) {
+                indices.push_back(i);
+            }
+        }
+        if (!csr) {
+            std::shuffle(indices.begin(), indices.end(), generator);
+        }
+        std::vector<float> values;
+        for (uint64_t i : indices) {
+            values.push_back(g[i]);
+        }
+        if (csr) {
+            std::vector<uint64_t> row_ptr(data_sz / row_len + 1, 0);
+            std::vector<uint64_t> col_idx;
+            for (uint64_t i : indices) {
+                ++row_ptr[i / row_len + 1];
+                col_idx.push_back(i % row_len);
+            }
+            for (size_t r = 1; r != row_ptr.size(); ++r) {
+                row_ptr[r] += row_ptr[r - 1];
+            }
+            p.set_sparse_data(w, data_sz / row_len, row_len, row_ptr, col_idx, values);
+        } else {
+            p.set_sparse_data(w, data_sz, indices, values);
         }
     }
+    s.prepare_verification();
+    p.prepare_verification();
     s.run();
-    for (uint32_t i = 0; i != num_workers; ++i) {
-        for (size_t j = 0; j != result.size(); ++j) {
-            assert(isclose(s.workers_[i].gradients_[j], result[j]));
+    p.run();
+    if (!p.verify() || p.get_time() != s.get_time() || p.get_rounds() != s.get_rounds()) {
+        std::cout << "FAIL" << std::endl;
+        std::exit(1);
+    }
+
+    std::cout << "PASS" << std::endl << std::endl;
+}
+
+// Sparsify the gradients of every worker to its top k blocks, and run
+// several collectives in a row, so that the residuals carry over
+void do_sparsify_test(uint32_t num_workers,
+                      uint32_t block_size,
+                      uint32_t bf_width,
+                      size_t data_sz,
+                      float sparsity,
+                      size_t k,
+                      uint32_t iterations) {
+    print_params("Sparsification test", num_workers, block_size, bf_width, data_sz, sparsity);
+    std::cout << "    Blocks kept: " << k << std::endl;
+    std::cout << "    Iterations: " << iterations << std::endl;
+
+    Simulator s(num_workers, block_size, bf_width);
+    s.set_sparsifier(Sparsifier::top_k(k));
+    for (uint32_t i = 0; i != iterations; ++i) {
+        s.generate_data(data_sz, block_size, sparsity);
+        s.sparsify();
+        for (workernum_t w = 0; w != num_workers; ++w) {
+            const Buffer<float>& g = s.gradients(w);
+            size_t nonzero = 0;
+            for (size_t b = 0; b != data_sz / block_size; ++b) {
+                nonzero += std::any_of(g.begin() + b * block_size,
+                                       g.begin() + (b + 1) * block_size,
+                                       [](float x) { return x != 0; });
+            }
+            if (nonzero > k) {
+                std::cout << "FAIL" << std::endl;
+                std::exit(1);
+            }
+        }
+        s.prepare_verification();
+        s.run();
+        // In the first round, workers send the first block of every column
+        // whether or not it is zero
+        if (!s.verify() || s.get_blocks() > (k + bf_width) * num_workers) {
+            std::cout << "FAIL" << std::endl;
+            std::exit(1);
         }
     }
 
     std::cout << "PASS" << std::endl << std::endl;
 }
-#endif
 
+// Run the bitmap protocol, sequentially and in parallel, and compare
+// its rounds with the chaining protocol on the same data
+void do_protocol_test(Collective collective,
+                      uint32_t num_workers,
+                      uint32_t block_size,
+                      uint32_t bf_width,
+                      size_t data_sz,
+                      float sparsity,
+                      uint32_t num_threads) {
+    print_params("Bitmap protocol test", num_workers, block_size, bf_width, data_sz, sparsity);
+    std::cout << "    Collective: " << collective_name(collective) << std::endl;
+    std::cout << "    Threads: " << num_threads << std::endl;
 
-int main() {
-#ifndef DEBUGGING
-    std::cerr << "This experiment must be compiled with D=1" << std::endl;
-#else
+    Simulator s(num_workers, block_size, bf_width, collective);
+    Simulator b(num_workers, block_size, bf_width, collective, BITMAP);
+    s.seed(1);
+    b.seed(1);
+    s.generate_data(data_sz, block_size, sparsity);
+    b.generate_data(data_sz, block_size, sparsity);
+
+    // Nonzero blocks of any worker
+    std::vector<char> nonzero(data_sz / block_size, 0);
+    for (workernum_t w = 0; w != num_workers; ++w) {
+        const Buffer<float>& g = b.gradients(w);
+        for (size_t i = 0; i != g.size(); ++i) {
+            nonzero[i / block_size] |= (g[i] != 0);
+        }
+    }
+    const size_t num_nonzero = std::count(nonzero.begin(), nonzero.end(), 1);
+
+    b.prepare_verification();
+    run_alike(b, [num_threads](auto& p) { p.run_parallel(num_threads); });
+    s.run();
+    if (!b.verify() ||
+        b.get_rounds() != (num_nonzero + bf_width - 1) / bf_width ||
+        b.get_rounds() > s.get_rounds()) {
+        std::cout << "FAIL" << std::endl;
+        std::exit(1);
+    }
+
+    std::cout << "PASS" << std::endl << std::endl;
+}
+
+// Lose packets on all links, and compare with the same data without loss
+void do_loss_test(Protocol protocol,
+                  Collective collective,
+                  uint32_t num_workers,
+                  uint32_t block_size,
+                  uint32_t bf_width,
+                  size_t data_sz,
+                  float sparsity,
+                  double loss) {
+    print_params("Packet loss test", num_workers, block_size, bf_width, data_sz, sparsity);
+    std::cout << "    Protocol: " << protocol_name(protocol) << std::endl;
+    std::cout << "    Collective: " << collective_name(collective) << std::endl;
+    std::cout << "    Loss probability: " << loss << std::endl;
+
+    Simulator s(num_workers, block_size, bf_width, collective, protocol);
+    s.seed(1);
+    s.generate_data(data_sz, block_size, sparsity);
+    s.prepare_verification();
+    Simulator l = s;
+    l.set_loss(loss, DEFAULT_TIMEOUT, 1);
+    s.run();
+    l.run();
+    if (!l.verify() || l.get_rounds() != s.get_rounds() ||
+        l.get_time() < s.get_time() || l.get_lost_packets() == 0) {
+        std::cout << "FAIL" << std::endl;
+        std::exit(1);
+    }
+
+    std::cout << "PASS" << std::endl << std::endl;
+}
+
+// Charge the per-column overhead for active columns only, sequentially and
+// in parallel, over two collectives, and compare with the full width
+void do_adaptive_test(Collective collective,
+                      uint32_t num_workers,
+                      uint32_t block_size,
+                      uint32_t bf_width,
+                      size_t data_sz,
+                      float sparsity,
+                      uint32_t num_threads) {
+    print_params("Adaptive width test", num_workers, block_size, bf_width, data_sz, sparsity);
+    std::cout << "    Collective: " << collective_name(collective) << std::endl;
+    std::cout << "    Threads: " << num_threads << std::endl;
+
+    Simulator s(num_workers, block_size, bf_width, collective);
+    Simulator a(num_workers, block_size, bf_width, collective);
+    a.set_adaptive_width(true);
+    s.seed(1);
+    a.seed(1);
+    for (uint32_t k = 0; k != 2; ++k) {
+        s.generate_data(data_sz, block_size, sparsity);
+        a.generate_data(data_sz, block_size, sparsity);
+        a.prepare_verification();
+        run_alike(a, [num_threads](auto& p) { p.run_parallel(num_threads); });
+        s.run();
+        if (!a.verify() || a.get_rounds() != s.get_rounds() || a.get_time() > s.get_time()) {
+            std::cout << "FAIL" << std::endl;
+            std::exit(1);
+        }
+    }
+
+    std::cout << "PASS" << std::endl << std::endl;
+}
+
+// Aggregate in a pool of slots smaller than a fused packet, sequentially,
+// in parallel and with packet loss, and compare with unlimited memory
+void do_slot_test(Collective collective,
+                  uint32_t num_workers,
+                  uint32_t block_size,
+                  uint32_t bf_width,
+                  size_t data_sz,
+                  float sparsity,
+                  uint32_t num_slots,
+                  uint32_t slot_size) {
+    print_params("Slot pool test", num_workers, block_size, bf_width, data_sz, sparsity);
+    std::cout << "    Collective: " << collective_name(collective) << std::endl;
+    std::cout << "    Slots: " << num_slots << std::endl;
+    std::cout << "    Slot size (elements): " << slot_size << std::endl;
 
+    Simulator s(num_workers, block_size, bf_width, collective);
+    s.seed(1);
+    s.generate_data(data_sz, block_size, sparsity);
+    s.prepare_verification();
+    Simulator p = s;
+    p.set_slot_pool(num_slots, slot_size);
+    Simulator l = p;
+    l.set_loss(0.05, DEFAULT_TIMEOUT, 1);
+    run_alike(p, [](auto& q) { q.run_parallel(2); });
+    s.run();
+    l.run();
+    if (!p.verify() || !l.verify() ||
+        p.get_blocks() != s.get_blocks() ||
+        p.get_rejected_blocks() == 0 ||
+        p.get_rounds() <= s.get_rounds()) {
+        std::cout << "FAIL" << std::endl;
+        std::exit(1);
+    }
+
+    std::cout << "PASS" << std::endl << std::endl;
+}
+
+// A process that reaches a barrier after a delay, and then reports
+// the time to a mailbox
+static Process do_barrier_process(Scheduler& scheduler,
+                                  Barrier& barrier,
+                                  Mailbox<timestamp_t>& times,
+                                  timedelta_t delta) {
+    co_await scheduler.delay(delta);
+    co_await barrier.arrive_and_wait();
+    times.put(scheduler.now());
+}
+
+// Receives the times of the processes, and checks that they all
+// continued from the barrier at the latest arrival
+static Process do_receive_process(Mailbox<timestamp_t>& times,
+                                  uint32_t count,
+                                  timestamp_t expected,
+                                  bool& ok) {
+    for (uint32_t i = 0; i != count; ++i) {
+        const timestamp_t time = co_await times.receive();
+        ok = ok && time == expected;
+    }
+}
+
+// Check delays, mailboxes and barriers of simulation processes, and
+// run the collective with processes to compare it with events
+void do_process_test(Protocol protocol,
+                     Collective collective,
+                     uint32_t num_workers,
+                     uint32_t block_size,
+                     uint32_t bf_width,
+                     size_t data_sz,
+                     float sparsity) {
+    print_params("Process test", num_workers, block_size, bf_width, data_sz, sparsity);
+    std::cout << "    Protocol: " << protocol_name(protocol) << std::endl;
+    std::cout << "    Collective: " << collective_name(collective) << std::endl;
+
+    bool ok = true;
+    {
+        Scheduler scheduler(100);
+        Barrier barrier(scheduler, num_workers);
+        Mailbox<timestamp_t> times(scheduler);
+        scheduler.spawn(do_receive_process(times, num_workers, 100 + 10 * num_workers, ok));
+        for (uint32_t w = 0; w != num_workers; ++w) {
+            scheduler.spawn(do_barrier_process(scheduler, barrier, times, 10 * (w + 1)));
+        }
+        scheduler.run();
+        ok = ok && scheduler.now() == 100 + 10 * num_workers && times.size() == 0;
+    }
+
+    Simulator s(num_workers, block_size, bf_width, collective, protocol);
+    s.seed(1);
+    s.generate_data(data_sz, block_size, sparsity);
+    s.prepare_verification();
+    run_alike(s, [](auto& p) { p.run_processes(); });
+    if (!ok) {
+        std::cout << "FAIL" << std::endl;
+        std::exit(1);
+    }
+
+    std::cout << "PASS" << std::endl << std::endl;
+}
+
+// Run the loops over columns in parallel for every step, and compare the
+// results bit by bit with serial loops
+void do_column_test(Protocol protocol,
+                    Collective collective,
+                    uint32_t num_workers,
+                    uint32_t block_size,
+                    uint32_t bf_width,
+                    size_t data_sz,
+                    float sparsity) {
+    print_params("Column parallelism test", num_workers, block_size, bf_width, data_sz, sparsity);
+    std::cout << "    Protocol: " << protocol_name(protocol) << std::endl;
+    std::cout << "    Collective: " << collective_name(collective) << std::endl;
+
+    Simulator s(num_workers, block_size, bf_width, collective, protocol);
+    s.set_parallel_threshold(static_cast<size_t>(-1));
+    s.seed(1);
+    s.generate_data(data_sz, block_size, sparsity);
+    s.prepare_verification();
+    const Simulator p = run_alike(s, [](auto& q) {
+        q.set_parallel_threshold(0);
+        q.run();
+    });
+    bool same = true;
+    for (workernum_t w = 0; w != num_workers && same; ++w) {
+        const Buffer<float>& a = s.gradients(w);
+        const Buffer<float>& b = p.gradients(w);
+        same = std::equal(a.begin(), a.end(), b.begin(), b.end(), [](float x, float y) {
+            return std::memcmp(&x, &y, sizeof(float)) == 0;
+        });
+    }
+    if (!same) {
+        std::cout << "FAIL" << std::endl;
+        std::exit(1);
+    }
+
+    std::cout << "PASS" << std::endl << std::endl;
+}
+
+// Parse a model description and check its buckets, and run a bucketed
+// allreduce whose buckets are smaller than a fused packet
+void do_model_test(uint32_t num_workers,
+                   uint32_t block_size,
+                   uint32_t bf_width,
+                   float sparsity) {
+    std::istringstream description("# name, elements, backward time\n"
+                                   "embedding 1000 50\n"
+                                   "\n"
+                                   "layer0 300 20\n"
+                                   "layer1 100 10\n"
+                                   "head 20 5\n");
+    const Model m = Model::parse(description);
+    print_params("Model test", num_workers, block_size, bf_width, m.size(), sparsity);
+
+    // Buckets are filled in backward order, and closed once full
+    bool ok = m.tensors().size() == 4 && m.size() == 1420 && m.backward_time() == 85;
+    const std::vector<Bucket> buckets = m.make_buckets(400);
+    ok = ok && buckets.size() == 2 &&
+         buckets[0].tensors_ == std::vector<size_t>{3, 2, 1} &&
+         buckets[0].size_ == 420 && buckets[0].ready_time_ == 35 &&
+         buckets[1].tensors_ == std::vector<size_t>{0} &&
+         buckets[1].size_ == 1000 && buckets[1].ready_time_ == 85;
+    const std::vector<Bucket> singles = m.make_buckets(1);
+    const timestamp_t ready_times[] = {5, 15, 35, 85};
+    ok = ok && singles.size() == 4;
+    for (size_t b = 0; b != singles.size() && ok; ++b) {
+        ok = singles[b].tensors_ == std::vector<size_t>{3 - b} &&
+             singles[b].ready_time_ == ready_times[b];
+    }
+
+    static constexpr const char* malformed[] = {"a 10", "a 10 5 6", "a x 5", "a 0 5"};
+    for (const char* line : malformed) {
+        std::istringstream in(line);
+        try {
+            Model::parse(in);
+            ok = false;
+        } catch (const std::invalid_argument&) {
+        }
+    }
+
+    // Runs with the same seed give the same times
+    BucketedSimulator s(m, 400, num_workers, block_size, bf_width);
+    BucketedSimulator r(m, 400, num_workers, block_size, bf_width);
+    s.set_sparsity(sparsity);
+    r.set_sparsity(sparsity);
+    s.seed(7);
+    r.seed(7);
+    s.run();
+    r.run();
+    ok = ok && s.get_time() == r.get_time() &&
+         s.get_communication_time() == r.get_communication_time();
+
+    // A bucket takes as long as its data padded to whole blocks alone
+    Model tiny;
+    tiny.add_tensor("tiny", 100, 0);
+    BucketedSimulator b(tiny, 1, num_workers, block_size, bf_width);
+    b.set_sparsity(sparsity);
+    b.seed(7);
+    b.run();
+    Simulator t(num_workers, block_size, bf_width);
+    t.seed(7);
+    t.generate_data((100 + block_size - 1) / block_size * block_size, block_size, sparsity);
+    t.run();
+    if (!ok || b.get_communication_time() != t.get_time()) {
+        std::cout << "FAIL" << std::endl;
+        std::exit(1);
+    }
+
+    std::cout << "PASS" << std::endl << std::endl;
+}
+
+// Fraction of zero blocks in a mask drawn from a pattern
+static double zero_fraction(SparsityPattern& pattern, size_t num_blocks, uint32_t seed) {
+    std::vector<char> mask(num_blocks);
+    std::mt19937 generator(seed);
+    pattern.prepare(num_blocks);
+    pattern.generate(mask, generator);
+    return static_cast<double>(std::count(mask.begin(), mask.end(), 0)) / num_blocks;
+}
+
+// Check that the patterns give the requested fraction of zero blocks, and
+// that correlation 1 gives all workers the same mask and correlation 0
+// gives them independent ones
+void do_pattern_test(size_t num_blocks, float sparsity) {
+    std::cout << "Sparsity pattern test params:" << std::endl;
+    std::cout << "    Number of blocks: " << num_blocks << std::endl;
+    std::cout << "    Sparsity: " << sparsity << std::endl;
+
+    // The fraction of nonzero blocks is off by at most 5%, and
+    // by a little more for the noise of nearly dense data
+    const double tolerance = 0.05 * (1.0 - sparsity) + 0.002;
+    UniformPattern uniform(sparsity);
+    ZipfPattern zipf(sparsity, 1.0, 1);
+    ZipfPattern steep(sparsity, 2.0, 1);
+    BurstyPattern bursty(sparsity, 8.0);
+    bool ok = true;
+    for (SparsityPattern* pattern : {static_cast<SparsityPattern*>(&uniform),
+                                     static_cast<SparsityPattern*>(&zipf),
+                                     static_cast<SparsityPattern*>(&steep),
+                                     static_cast<SparsityPattern*>(&bursty)}) {
+        ok = ok && std::abs(zero_fraction(*pattern, num_blocks, 1) - sparsity) < tolerance;
+    }
+
+    CorrelatedPattern same(zipf, 1.0, 1);
+    CorrelatedPattern independent(bursty, 0.0, 1);
+    same.prepare(num_blocks);
+    independent.prepare(num_blocks);
+    std::vector<char> first(num_blocks);
+    std::vector<char> second(num_blocks);
+    std::vector<char> base(num_blocks);
+    std::mt19937 first_generator(1);
+    std::mt19937 second_generator(2);
+    same.generate(first, first_generator);
+    same.generate(second, second_generator);
+    ok = ok && first == second;
+    // Without correlation, each worker draws from the base pattern alone
+    std::mt19937 base_generator(3);
+    std::mt19937 generator(3);
+    independent.generate(first, generator);
+    bursty.generate(base, base_generator);
+    ok = ok && first == base;
+    if (!ok) {
+        std::cout << "FAIL" << std::endl;
+        std::exit(1);
+    }
+
+    std::cout << "PASS" << std::endl << std::endl;
+}
+
+// Run a job on the multi-job simulator alone, with a server for every
+// worker, and compare it with Simulator::run. Then run two jobs together,
+// and check that the scheduling policies favour the expected job: the
+// one with the larger weight with weighted fair queueing, and a small job
+// next to a large one more with round robin than first come first served
+void do_multijob_test(uint32_t num_workers,
+                      uint32_t block_size,
+                      uint32_t bf_width,
+                      size_t data_sz,
+                      float sparsity) {
+    print_params("Multi-job test", num_workers, block_size, bf_width, data_sz, sparsity);
+
+    Simulator s(num_workers, block_size, bf_width);
+    s.seed(1);
+    s.generate_data(data_sz, block_size, sparsity);
+    s.prepare_verification();
+    Simulator r = s;
+    r.run();
+    // A job that has run already runs its next collective
+    Simulator again = r;
+    again.prepare_verification();
+    Simulator a = again;
+    a.run();
+
+    FifoPolicy compute;
+    FifoPolicy link;
+    MultiJobSimulator m(compute, link, num_workers);
+    m.add_job(s);
+    m.add_job(again, r.get_time() + 1);
+    m.run();
+    bool ok = m.verify() &&
+              m.get_completion_time(0) == r.get_time() &&
+              m.get_solo_time(0) == r.get_time() &&
+              m.get_completion_time(1) == a.get_time() - r.get_time();
+    // The jobs are left as added, so running again gives the same times
+    const uint64_t time = m.get_time();
+    m.run();
+    ok = ok && m.verify() && m.get_time() == time;
+    // Jobs may lose packets
+    Simulator lossy = s;
+    lossy.set_loss(0.05, DEFAULT_TIMEOUT, 1);
+    MultiJobSimulator l(compute, link, num_workers);
+    l.add_job(lossy);
+    l.run();
+    ok = ok && l.verify() && l.get_completion_time(0) >= r.get_time();
+
+    // Identical jobs finish in the order of their weights
+    for (uint32_t k = 0; k != 2; ++k) {
+        const std::vector<double> weights = (k == 0) ? std::vector<double>{4.0, 1.0}
+                                                     : std::vector<double>{1.0, 4.0};
+        WeightedFairPolicy wfq_compute(weights), wfq_link(weights);
+        MultiJobSimulator shared(wfq_compute, wfq_link);
+        shared.add_job(s);
+        shared.add_job(s);
+        shared.run();
+        ok = ok && shared.verify() &&
+             shared.get_completion_time(k) < shared.get_completion_time(1 - k);
+    }
+
+    // Completion times of the small job next to the large one with first
+    // come first served, round robin, and weighted fair queueing that
+    // favours the small and the large job
+    Simulator large(4 * num_workers, block_size, bf_width);
+    large.seed(2);
+    large.generate_data(data_sz, block_size, sparsity);
+    large.prepare_verification();
+    uint64_t small_times[4];
+    for (uint32_t k = 0; k != 4; ++k) {
+        FifoPolicy fifo_compute, fifo_link;
+        RoundRobinPolicy rr_compute, rr_link;
+        WeightedFairPolicy small_compute({1.0, 4.0}), small_link({1.0, 4.0});
+        WeightedFairPolicy large_compute({4.0, 1.0}), large_link({4.0, 1.0});
+        SchedulingPolicy* computes[] = {&fifo_compute, &rr_compute, &small_compute, &large_compute};
+        SchedulingPolicy* links[] = {&fifo_link, &rr_link, &small_link, &large_link};
+        MultiJobSimulator shared(*computes[k], *links[k]);
+        shared.add_job(large);
+        shared.add_job(s);
+        shared.run();
+        small_times[k] = shared.get_completion_time(1);
+        ok = ok && shared.verify() &&
+             shared.get_slowdown(0) >= 1.0 && shared.get_slowdown(1) >= 1.0;
+    }
+    if (!ok || small_times[1] > small_times[0] || small_times[2] > small_times[3]) {
+        std::cout << "FAIL" << std::endl;
+        std::exit(1);
+    }
+
+    std::cout << "PASS" << std::endl << std::endl;
+}
+
+// Run sweep points through a result cache in a temporary file, and check
+// that points are found again, also by another cache on the same file,
+// that any change of the configuration misses, and that a line cut short
+// is skipped
+void do_cache_test(uint32_t num_workers,
+                   uint32_t block_size,
+                   uint32_t bf_width,
+                   size_t data_sz,
+                   float sparsity) {
+    print_params("Result cache test", num_workers, block_size, bf_width, data_sz, sparsity);
+
+    char path[] = "/tmp/exp-3-cache-XXXXXX";
+    const int fd = mkstemp(path);
+    if (fd < 0) {
+        std::cout << "FAIL" << std::endl;
+        std::exit(1);
+    }
+    close(fd);
+
+    const SweepPoint point = {num_workers, block_size, bf_width, data_sz, sparsity, 1};
+    Simulator s(num_workers, block_size, bf_width);
+    s.seed(1);
+    s.generate_data(data_sz, block_size, sparsity);
+    s.run();
+
+    ResultCache cache(path);
+    const SweepResult first = cache.run(point);
+    const SweepResult second = cache.run(point);
+    bool ok = first.time_ == s.get_time() && first.rounds_ == s.get_rounds() &&
+              second.time_ == first.time_ && second.rounds_ == first.rounds_ &&
+              cache.get_hits() == 1 && cache.get_misses() == 1;
+
+    // Every field of the configuration is part of the key
+    std::vector<SweepPoint> changed(6, point);
+    ++changed[0].num_workers_;
+    changed[1].block_size_ *= 2;
+    ++changed[2].bf_width_;
+    changed[3].data_size_ += block_size;
+    changed[4].sparsity_ /= 2;
+    ++changed[5].seed_;
+    for (const SweepPoint& p : changed) {
+        cache.run(p);
+    }
+    ok = ok && cache.get_hits() == 1 && cache.get_misses() == 1 + changed.size();
+
+    if (ResultCache::versioned()) {
+        // Cut the last line short, as an interrupted sweep would
+        std::ifstream in(path);
+        std::string contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        in.close();
+        contents.resize(contents.rfind(',', contents.size() - 2));
+        std::ofstream(path, std::ios::trunc) << contents;
+
+        ResultCache reloaded(path);
+        const SweepResult loaded = reloaded.run(point);
+        for (size_t i = 0; i + 1 != changed.size(); ++i) {
+            reloaded.run(changed[i]);
+        }
+        ok = ok && loaded.time_ == first.time_ && loaded.rounds_ == first.rounds_ &&
+             reloaded.get_hits() == changed.size() && reloaded.get_misses() == 0;
+        reloaded.run(changed.back());
+        ok = ok && reloaded.get_misses() == 1;
+    }
+    std::remove(path);
+    if (!ok) {
+        std::cout << "FAIL" << std::endl;
+        std::exit(1);
+    }
+
+    std::cout << "PASS" << std::endl << std::endl;
+}
+
+int main() {
     do_test(4, 64, 4, 1 << 20, 0.90);
     do_test(3, 128, 7, 1 << 18, 0.87);
     do_test(2, 8, 1, 1 << 18, 0.99);
     do_test(6, 7, 13, 700000, 0.999);
     do_test(6, 7, 13, 700000, 0.1);
+    do_test(4, 64, 32, 64 * 5, 0.5);
+    do_parallel_test(4, 64, 4, 1 << 20, 0.90, 2);
+    do_parallel_test(33, 16, 16, 1 << 18, 0.95, 4);
+    do_parallel_test(6, 7, 13, 700000, 0.1, 8);
+    do_collective_test(REDUCE_SCATTER, 4, 64, 4, 1 << 20, 0.90);
+    do_collective_test(REDUCE_SCATTER, 6, 7, 13, 700000, 0.1);
+    do_collective_test(REDUCE_SCATTER, 5, 8, 3, 8 * 13, 0.5);
+    do_collective_test(ALL_GATHER, 4, 64, 4, 1 << 20, 0.90);
+    do_collective_test(ALL_GATHER, 6, 7, 13, 700000, 0.1);
+    do_collective_test(BROADCAST, 3, 128, 7, 1 << 18, 0.87);
+    do_collective_test(BROADCAST, 6, 7, 13, 700000, 0.999);
+    do_type_test<double>("double", 4, 64, 4, 1 << 20, 0.90);
+    do_type_test<double>("double", 6, 7, 13, 700000, 0.1);
+    do_type_test<bf16>("bf16", 4, 64, 4, 1 << 20, 0.90);
+    do_type_test<bf16>("bf16", 33, 16, 16, 1 << 18, 0.5);
+    do_type_test<int32_t>("int32", 4, 64, 4, 1 << 20, 0.90);
+    do_type_test<int32_t>("int32", 6, 7, 13, 700000, 0.1);
+    do_sparse_test(false, 4, 64, 4, 1 << 20, 0.90, 0);
+    do_sparse_test(false, 6, 7, 13, 700000, 0.999, 0);
+    do_sparse_test(true, 3, 128, 7, 1 << 18, 0.87, 1024);
+    do_sparse_test(true, 6, 7, 13, 700000, 0.1, 700);
+    do_sparsify_test(4, 64, 4, 1 << 20, 0.5, 1000, 3);
+    do_sparsify_test(6, 7, 13, 700000, 0.9, 5000, 2);
+    do_sparsify_test(3, 128, 7, 1 << 18, 0.99, 1 << 20, 2);
+    do_protocol_test(ALLREDUCE, 4, 64, 4, 1 << 20, 0.90, 2);
+    do_protocol_test(ALLREDUCE, 6, 7, 13, 700000, 0.999, 3);
+    do_protocol_test(ALLREDUCE, 33, 16, 16, 1 << 18, 0.1, 4);
+    do_protocol_test(REDUCE_SCATTER, 6, 7, 13, 700000, 0.5, 2);
+    do_protocol_test(ALL_GATHER, 4, 64, 4, 1 << 20, 0.90, 2);
+    do_protocol_test(BROADCAST, 3, 128, 7, 1 << 18, 0.87, 2);
+    do_loss_test(CHAINING, ALLREDUCE, 4, 64, 4, 1 << 18, 0.90, 0.01);
+    do_loss_test(CHAINING, ALLREDUCE, 6, 7, 13, 70000, 0.5, 0.2);
+    do_loss_test(CHAINING, REDUCE_SCATTER, 5, 8, 3, 8 * 1300, 0.5, 0.05);
+    do_loss_test(BITMAP, ALLREDUCE, 4, 64, 4, 1 << 18, 0.90, 0.05);
+    do_loss_test(BITMAP, BROADCAST, 3, 128, 7, 1 << 18, 0.87, 0.1);
+    do_adaptive_test(ALLREDUCE, 4, 64, 4, 1 << 20, 0.90, 2);
+    do_adaptive_test(ALLREDUCE, 6, 7, 13, 700000, 0.999, 3);
+    do_adaptive_test(ALLREDUCE, 33, 16, 64, 1 << 18, 0.99, 4);
+    do_adaptive_test(REDUCE_SCATTER, 5, 8, 3, 8 * 1300, 0.5, 2);
+    do_adaptive_test(BROADCAST, 3, 128, 7, 1 << 18, 0.87, 2);
+    do_slot_test(ALLREDUCE, 4, 64, 4, 1 << 20, 0.90, 2, 64);
+    do_slot_test(ALLREDUCE, 6, 7, 13, 700000, 0.5, 5, 4);
+    do_slot_test(ALLREDUCE, 33, 16, 64, 1 << 18, 0.99, 8, 16);
+    do_slot_test(REDUCE_SCATTER, 5, 8, 3, 8 * 1300, 0.5, 1, 8);
+    do_slot_test(BROADCAST, 3, 128, 7, 1 << 18, 0.87, 12, 32);
+    do_process_test(CHAINING, ALLREDUCE, 4, 64, 4, 1 << 20, 0.90);
+    do_process_test(CHAINING, ALLREDUCE, 6, 7, 13, 700000, 0.999);
+    do_process_test(CHAINING, REDUCE_SCATTER, 5, 8, 3, 8 * 1300, 0.5);
+    do_process_test(BITMAP, ALLREDUCE, 33, 16, 16, 1 << 18, 0.1);
+    do_process_test(BITMAP, ALL_GATHER, 4, 64, 4, 1 << 20, 0.90);
+    do_column_test(CHAINING, ALLREDUCE, 4, 64, 4, 1 << 20, 0.90);
+    do_column_test(CHAINING, ALLREDUCE, 6, 7, 13, 700000, 0.5);
+    do_column_test(CHAINING, ALLREDUCE, 3, 1024, 256, 1 << 22, 0.9);
+    do_column_test(CHAINING, REDUCE_SCATTER, 5, 8, 3, 8 * 1300, 0.5);
+    do_column_test(BITMAP, ALLREDUCE, 4, 512, 64, 1 << 20, 0.5);
+    do_cache_test(4, 64, 4, 1 << 16, 0.90);
+    do_multijob_test(4, 64, 4, 1 << 18, 0.90);
+    do_multijob_test(6, 7, 13, 70000, 0.5);
+    do_multijob_test(3, 128, 7, 1 << 18, 0.87);
+    do_pattern_test(1 << 18, 0.0);
+    do_pattern_test(1 << 18, 0.5);
+    do_pattern_test(1 << 18, 0.99);
+    do_model_test(4, 16, 32, 0.5);
+    do_model_test(3, 64, 4, 0.0);
     std::cout << "All tests passed" << std::endl;
-#endif
     return 0;
-}
\ No newline at end of file
+}
@@ -1,7 +1,7 @@
 #include <iostream>
 #include <cassert>
 
-#include "simulator.h"
+#include "cache.h"
 #include "utils.h"
 
 static constexpr uint32_t block_size = 64;
@@ -12,6 +12,8 @@ static constexpr uint32_t nums_workers[] = {2, 4, 8};
 
 static constexpr size_t data_size = 1UL << 25;
 
+static constexpr uint32_t seed = 42;
+
 extern uint64_t computation_time;
 extern uint64_t network_time;
 
@@ -20,16 +22,19 @@ int main() {
     std::cerr << "Warning: it is recommended to run this experiment "
                  "without D=1 and without V=1" << std::endl;
 #endif
+    // Points computed by earlier runs are read from the cache
+    ResultCache cache(ResultCache::default_path());
     std::cout << "num_workers,sparsity,time" << std::endl;
 
     for (uint32_t i = 0; i != sizeof(nums_workers) / sizeof(uint32_t); ++i) {
         for (uint32_t j = 0; j != sizeof(sparsities) / sizeof(float); ++j) {
-            Simulator s(nums_workers[i], block_size, bf_width);
-            s.generate_data(data_size, block_size, sparsities[j]);
-            s.run();
+            SweepResult r = cache.run({nums_workers[i], block_size, bf_width,
+                                       data_size, sparsities[j], seed});
             std::cout << nums_workers[i] << ","
                       << sparsities[j] << ","
-                      << float(s.get_time()) / 1e6 << std::endl;
+                      << float(r.time_) / 1e6 << std::endl;
         }
     }
+    std::cerr << "Cached points: " << cache.get_hits()
+              << ", simulated points: " << cache.get_misses() << std::endl;
 }
@@ -4,42 +4,113 @@
 //#include <cstdlib>
 #include <cstdint>
 #include <queue>
+#include <memory>
 
 #include "types.h"
 #include "event.h"
 #include "block.h"
+#include "element.h"
+#include "kernels.h"
+#include "bitmap.h"
 
+template <typename T>
 class Worker;
 
+// T is the element type of the gradients
+template <typename T = float>
 class Aggregator {
 public:
-    Aggregator(workernum_t num_workers, uint32_t block_size, uint32_t bf_width);
+    Aggregator(workernum_t num_workers,
+               uint32_t block_size,
+               uint32_t bf_width,
+               Collective collective = ALLREDUCE,
+               Protocol protocol = CHAINING);
 
-    // Copy the packet from a worker to the aggregator
-    void recv_packet(const Packet& packet);
+    // Receive the packet from a worker. The payload is accumulated into
+    // the aggregation slot right away, and only the next block IDs are kept
+    void recv_packet(const Packet<T>& packet);
 
-    // Process the response from a given worker,
+    // Receive the bitmap of a worker's nonzero blocks, with the bitmap
+    // protocol. Once all bitmaps are in, preparing to send schedules the
+    // rounds and multicasts the schedule instead of a packet
+    void recv_bitmap(workernum_t worker, const Bitmap& bitmap);
+
+    // Finish processing the packet from a given worker,
     // returns the time needed for the *next* step (prepare to send)
     timedelta_t process_response(workernum_t worker);
 
     // Prepare to send the packet,
-    // returns the time needed for the *next* step (send)
+    // returns the time needed for the *next* step (send). With reduce-scatter,
+    // this is only the time for the packet header, which all workers get
     timedelta_t prepare_to_send();
 
-    // Send the packet to a given worker,
-    // returns the time needed for the *next* step (worker process)
-    timedelta_t send(Worker& worker);
+    // Send the last prepared packet to a given worker,
+    // returns the time needed for the *next* step (worker process).
+    // With reduce-scatter, each worker gets the payload of its own blocks
+    // only, and the time also includes transferring that payload.
+    // All workers share the same read-only packet, and sending does not
+    // modify the aggregator, so packets can be sent to different
+    // workers concurrently
+    timedelta_t send(Worker<T>& worker) const;
 
     // Returns true iff packets from all required workers
     // have been received in this round
     bool all_received() const;
 
-    // Returns true iff packets have been sent to all workers
-    // in this round
-    bool all_sent() const;
+    // Number of rounds completed so far
+    uint64_t get_rounds() const;
 
-    // Resets per-round state
-    void reset();
+    // Number of packets received from workers so far
+    uint64_t get_packets() const;
+
+    // Number of valid blocks aggregated so far
+    uint64_t get_blocks() const;
+
+    // Number of valid blocks rejected for lack of a free slot so far
+    uint64_t get_rejected_blocks() const;
+
+    // Prepare for another collective, in whose first round all workers send.
+    // Statistics are reset as well
+    void restart();
+
+    // Spread the loops over the blocks of a packet over ThreadPool::instance()
+    // when a step touches at least threshold elements, see parallel_for_work
+    void set_parallel_threshold(size_t threshold);
+
+    // Charge the per-column overhead of packets for the columns that still
+    // have blocks to aggregate only, see Worker::set_adaptive_width
+    void set_adaptive_width(bool adaptive);
+
+    // Aggregate in a fixed pool of num_slots slots of slot_size elements
+    // each, like a programmable switch, rather than in unlimited memory.
+    // Each block takes enough slots for its elements, from the arrival of
+    // the first block of its column in a round until the end of the round.
+    // Blocks of a column that finds too few free slots are rejected, and
+    // requested again in the next round, which reserves slots for them
+    // first. Zero slots turn the pool off. Only the chaining protocol can
+    // retry blocks
+    void set_slot_pool(uint32_t num_slots, uint32_t slot_size);
+
+    // With lossy links, the aggregator keeps the results of all rounds, so
+    // that it can send them again, and remembers which workers it received
+    // a packet from in the current round, so that no packet is aggregated twice
+    void set_lossy(bool lossy);
+
+    // Number of results multicast so far, which is the sequence
+    // number of the round being aggregated
+    uint64_t get_seq() const;
+
+    // Returns true iff a packet of the current round from the given worker
+    // has not been received yet. Must be checked before receiving packets
+    // over lossy links
+    bool accepts(workernum_t worker) const;
+
+    // Time to send the result of an earlier round to one worker again
+    timedelta_t resend_time(uint64_t seq) const;
+
+    // Send the result of an earlier round to one worker again,
+    // returns the time needed for the next step, like send
+    timedelta_t resend(Worker<T>& worker, uint64_t seq) const;
 
 private:
     const workernum_t num_workers_;
@@ -51,8 +122,14 @@ private:
     // (i.e. how many workers are required)
     uint32_t num_to_receive_;
 
-    // How many packets sent so far in this round
-    uint32_t num_sent_;
+    // How many rounds completed so far
+    uint64_t num_rounds_;
+
+    // How many packets received so far, across all rounds
+    uint64_t num_packets_;
+
+    // How many valid blocks received so far, across all rounds
+    uint64_t num_blocks_;
 
     // Aggregation block size, set at construction time
     const uint32_t block_size_;
@@ -60,17 +137,135 @@ private:
     // Block fusion width, set at construction time
     const uint32_t bf_width_;
 
+    // Loops over a block, specialized for the block size
+    const BlockKernels<T> kernels_;
+
+    // Collective operation, set at construction time
+    const Collective collective_;
+
+    // Protocol, set at construction time
+    const Protocol protocol_;
+
     // Minimum next nonzero blocks for each block in the fused packet
     // (i.e. the blocks to ask for in the next round)
     // min_next_.size() == bf_width_
     std::vector<blocknum_t> min_next_;
 
-    // Packets received from workers
-    // recv_blocks_.size() == num_workers_
-    std::vector<Packet> recv_packets_;
+    // Next nonzero block of each worker in each column, as reported in the
+    // last packet from the worker, or BLOCK_INF once that block has been
+    // requested. Stored column by column, the entry for column i and
+    // worker j is next_[i * num_workers_ + j]
+    // next_.size() == bf_width_ * num_workers_
+    std::vector<blocknum_t> next_;
+
+    // Fusion columns that still have blocks to aggregate, in increasing
+    // order. With the chaining protocol, a column is dropped once no more
+    // blocks are requested in it, and the loops over packets only visit
+    // the remaining columns
+    std::vector<uint32_t> active_;
+
+    // Columns that ran dry in this round, and in the previous round. The
+    // last block of a column that ran dry is still in the multicast packet,
+    // which is recycled in the next round, so reset clears the column once more
+    std::vector<uint32_t> dry_;
+    std::vector<uint32_t> retired_;
+
+    // True iff the per-column overhead is charged for active_ only
+    bool adaptive_width_;
+
+    // Elements that a step must touch to run its loops over blocks in parallel
+    size_t parallel_threshold_;
+
+    // Columns whose blocks are aggregated from the packet being received
+    std::vector<uint32_t> accumulated_;
 
-    // Packet to be multicast to workers
-    Packet send_packet_;
+    // Slots in the pool and elements per slot, zero slots without a pool
+    uint32_t num_slots_;
+    uint32_t slot_size_;
+
+    // Slots that one block takes, and slots taken in this round
+    uint32_t slots_per_block_;
+    uint32_t slots_used_;
+
+    // Whether each column has slots in this round, see SlotState
+    // slot_state_.size() == bf_width_
+    enum SlotState : char {
+        SLOT_NONE,
+        SLOT_TAKEN,
+        SLOT_REJECTED
+    };
+    std::vector<char> slot_state_;
+
+    // Columns rejected in this round, in the order of rejection
+    std::vector<uint32_t> rejected_;
+
+    // How many valid blocks rejected so far, across all rounds
+    uint64_t num_rejected_;
+
+    // Take slots for a column in this round, if there are enough free ones
+    bool take_slots(uint32_t column);
+
+    // Packet being aggregated in this round
+    Packet<T> send_packet_;
+
+    // Packet prepared in the last round, being multicast to workers.
+    // Workers hold it while the next round is being aggregated
+    // into send_packet_
+    std::shared_ptr<Packet<T>> multicast_packet_;
+
+    // Number of valid blocks and columns in multicast_packet_
+    uint32_t multicast_valid_blocks_;
+    uint32_t multicast_columns_;
+
+    // With the bitmap protocol, true iff the bitmaps are being received
+    bool negotiating_;
+
+    // With the bitmap protocol, the bitmap of each worker
+    // bitmaps_.size() == num_workers_
+    std::vector<Bitmap> bitmaps_;
+
+    // With the bitmap protocol, the blocks of all rounds, bf_width_ per round
+    std::shared_ptr<const std::vector<blocknum_t>> schedule_;
+
+    // With the bitmap protocol, how many workers send in each round,
+    // and the round being aggregated
+    std::vector<uint32_t> contributors_;
+    uint64_t round_;
+
+    // True iff the last multicast is the schedule rather than a packet
+    bool multicast_schedule_;
+
+    // Bytes of the schedule on the wire
+    size_t schedule_bytes_;
+
+    // Schedule the rounds from the bitmaps, returns the time to multicast
+    // the schedule
+    timedelta_t prepare_schedule();
+
+    // A result that has been multicast. Without a packet, it is the schedule
+    struct Result {
+        std::shared_ptr<const Packet<T>> packet_;
+        uint32_t valid_blocks_;
+        uint32_t columns_;
+    };
+
+    // Number of results multicast so far
+    uint64_t seq_;
+
+    // True iff links can lose packets
+    bool lossy_;
+
+    // With lossy links, the results of all rounds so far, and whether
+    // a packet of the current round has been received from each worker
+    // history_.size() == seq_, received_.size() == num_workers_
+    std::vector<Result> history_;
+    std::vector<char> received_;
+
+    // Deliver a result to a worker, returns the time for the worker to process it
+    timedelta_t deliver(Worker<T>& worker, const Result& result) const;
+
+    // Resets per-round state
+    void reset();
 };
 
 #endif
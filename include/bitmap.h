@@ -0,0 +1,43 @@
+#ifndef _BITMAP_H_
+#define _BITMAP_H_
+
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+// Set of block IDs, one bit per block
+class Bitmap {
+public:
+    // An empty set of blocks [0, size)
+    Bitmap(size_t size = 0);
+
+    // Clear the set and change its size
+    void assign(size_t size);
+
+    void set(size_t i);
+    bool test(size_t i) const;
+
+    // Union with a bitmap of the same size
+    Bitmap& operator|=(const Bitmap& other);
+
+    size_t size() const;
+
+    // Number of blocks in the set
+    size_t count() const;
+
+    // Number of 64-bit words, the cost of one pass over the bitmap
+    size_t num_words() const;
+
+    // Bytes needed to send the set: the raw bitmap or a list of 32-bit
+    // block IDs, whichever is smaller
+    size_t compressed_bytes() const;
+
+    // Block IDs in the set, in increasing order
+    std::vector<uint64_t> blocks() const;
+
+private:
+    std::vector<uint64_t> words_;
+    size_t size_;
+};
+
+#endif
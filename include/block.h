@@ -6,14 +6,18 @@
 #include <cstdlib>
 
 #include "types.h"
+#include "element.h"
+#include "memory.h"
 
+// T is the element type of the gradients
+template <typename T = float>
 struct Block {
     // Initializes the block as an invalid block
     Block(uint32_t block_size);
 
     // Gradients in the block
-    // data_.size() == block_size * sizeof(float)
-    std::vector<float> data_;
+    // data_.size() == block_size
+    Buffer<T> data_;
 
     // Next non-zero block ID in this fusion column
     blocknum_t next_;
@@ -26,13 +30,14 @@ struct Block {
     void invalidate();
 };
 
+template <typename T = float>
 struct Packet {
     // Initializes a packet of invalid blocks
     Packet(uint32_t block_size, uint32_t bf_width);
 
     // The array of blocks in a packet
     // blocks_.size() == bf_width
-    std::vector<Block> blocks_;
+    std::vector<Block<T>> blocks_;
 
     // The worker id where this packet originated
     // Unused when the packet is sent from the aggregator to the workers
@@ -0,0 +1,70 @@
+#ifndef _CACHE_H_
+#define _CACHE_H_
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <unordered_map>
+
+#include "types.h"
+
+// One configuration of a parameter sweep. The data is generated with
+// uniform sparsity from the given seed, so a point always gives the same result
+struct SweepPoint {
+    workernum_t num_workers_;
+    uint32_t block_size_;
+    uint32_t bf_width_;
+    size_t data_size_;
+    float sparsity_;
+    uint32_t seed_;
+};
+
+struct SweepResult {
+    uint64_t time_;
+    uint64_t rounds_;
+};
+
+// Results of sweep points, kept in a file so that running a sweep again
+// only simulates the points that are not in the file yet. A point is
+// identified by a hash of its configuration, the cost model version and
+// the version of the code, so changing either invalidates the old results.
+// Each line of the file is "key,time,rounds", and new results are appended
+// as soon as they are computed
+class ResultCache {
+public:
+    // Load the results stored in the given file, which is created if it
+    // does not exist. An empty path disables the file, and every point
+    // is simulated. So does a build that does not know its version
+    ResultCache(const std::string& path);
+
+    // Returns true iff the build knows the version of the code, which
+    // the makefile takes from git. Without it, results of older code
+    // could not be told apart, so they are not kept in the file
+    static bool versioned();
+
+    // Path of the cache file: $RESULT_CACHE if it is set, or
+    // "results.cache" in the working directory
+    static std::string default_path();
+
+    // Returns the result of the point, simulating it
+    // only if it is not in the cache. Simulations are pinned
+    // to a NUMA node, see NodeBinding
+    SweepResult run(const SweepPoint& point);
+
+    // Number of points found in the cache and simulated so far
+    uint64_t get_hits() const;
+    uint64_t get_misses() const;
+
+private:
+    const std::string path_;
+
+    std::unordered_map<uint64_t, SweepResult> results_;
+
+    uint64_t hits_;
+    uint64_t misses_;
+
+    // FNV-1a hash of the point's configuration and the versions
+    static uint64_t key(const SweepPoint& point);
+};
+
+#endif
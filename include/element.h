@@ -0,0 +1,106 @@
+#ifndef _ELEMENT_H_
+#define _ELEMENT_H_
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <limits>
+
+// Brain floating point: the upper 16 bits of a float. Arithmetic is done in
+// float, and results are rounded to the nearest bf16, ties to even
+struct bf16 {
+    uint16_t bits_;
+
+    bf16() = default;
+
+    explicit bf16(float value) {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        if (std::isnan(value)) {
+            // Keep NaNs quiet, rounding could turn them into infinities
+            bits_ = static_cast<uint16_t>((bits >> 16) | 0x40);
+        } else {
+            bits += 0x7fff + ((bits >> 16) & 1);
+            bits_ = static_cast<uint16_t>(bits >> 16);
+        }
+    }
+
+    operator float() const {
+        const uint32_t bits = static_cast<uint32_t>(bits_) << 16;
+        float value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+};
+
+// Properties of the element types that gradients can have. Gradients are
+// generated from uniform samples in [0, 1), which integers quantize to
+// [-128, 127]. Epsilon is the relative rounding error of one addition
+template <typename T>
+struct ElementTraits;
+
+template <>
+struct ElementTraits<float> {
+    static float from_uniform(double u) { return static_cast<float>(u); }
+    static constexpr double epsilon = std::numeric_limits<float>::epsilon();
+};
+
+template <>
+struct ElementTraits<double> {
+    static double from_uniform(double u) { return u; }
+    static constexpr double epsilon = std::numeric_limits<double>::epsilon();
+};
+
+template <>
+struct ElementTraits<bf16> {
+    static bf16 from_uniform(double u) { return bf16(static_cast<float>(u)); }
+    // 8 significant bits
+    static constexpr double epsilon = 1.0 / 128;
+};
+
+template <>
+struct ElementTraits<int32_t> {
+    static int32_t from_uniform(double u) {
+        return static_cast<int32_t>(std::floor(u * 256)) - 128;
+    }
+    // Integer sums are exact
+    static constexpr double epsilon = 0.0;
+};
+
+// Add n elements of src to dst, the inner loop of aggregation
+template <typename T>
+inline void accumulate(T* __restrict dst, const T* __restrict src, size_t n) {
+    for (size_t i = 0; i != n; ++i) {
+        dst[i] += src[i];
+    }
+}
+
+// Integer adders wrap around on overflow, like the ones in a switch
+template <>
+inline void accumulate<int32_t>(int32_t* __restrict dst, const int32_t* __restrict src, size_t n) {
+    for (size_t i = 0; i != n; ++i) {
+        dst[i] = static_cast<int32_t>(static_cast<uint32_t>(dst[i]) + static_cast<uint32_t>(src[i]));
+    }
+}
+
+template <>
+inline void accumulate<bf16>(bf16* __restrict dst, const bf16* __restrict src, size_t n) {
+    for (size_t i = 0; i != n; ++i) {
+        dst[i] = bf16(static_cast<float>(dst[i]) + static_cast<float>(src[i]));
+    }
+}
+
+// Time to send the payload of the given number of blocks over a link,
+// proportional to its size in bytes
+template <typename T>
+inline double wire_time(uint32_t block_size, uint32_t num_blocks) {
+    return 0.2 * sizeof(T) * block_size * num_blocks;
+}
+
+// Time to send the given number of bytes of metadata over a link
+inline double wire_time_bytes(size_t bytes) {
+    return 0.2 * bytes;
+}
+
+#endif
@@ -11,15 +11,25 @@ enum EventType {
     WORKER_SEND,
     AGGREGATOR_PROCESS,
     AGGREGATOR_PREPARE,
+    // Multicast of the aggregated packet, a single event for a range
+    // of workers starting with worker_id_
     AGGREGATOR_SEND,
-    INIT_EVENT
+    // Start of the simulation, a single event for a range
+    // of workers starting with worker_id_
+    INIT_EVENT,
+    // Retransmission timer of a worker, for the round seq_
+    WORKER_TIMEOUT,
+    // The aggregator sends the result of round seq_ again,
+    // to worker_id_ only
+    AGGREGATOR_RESEND
 };
 
 struct Event {
     Event(EventType type,
           workernum_t worker_id,
           timestamp_t start_timestamp,
-          timestamp_t end_timestamp);
+          timestamp_t end_timestamp,
+          uint64_t seq = 0);
     bool operator<(const Event& rhs) const;
     bool operator>(const Event& rhs) const;
 
@@ -27,6 +37,10 @@ struct Event {
     workernum_t worker_id_;
     timestamp_t start_timestamp_;
     timestamp_t end_timestamp_;
+
+    // Round that a packet, a result or a timer belongs to, counting every
+    // multicast of the aggregator. Only used when packets can be lost
+    uint64_t seq_;
 };
 
 #endif
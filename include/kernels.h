@@ -0,0 +1,35 @@
+#ifndef _KERNELS_H_
+#define _KERNELS_H_
+
+#include <cstdint>
+#include <cstdlib>
+
+#include "element.h"
+
+// Loops over the elements of a single block. Block sizes that are powers of
+// two from MIN_SPECIALIZED_BLOCK_SIZE to MAX_SPECIALIZED_BLOCK_SIZE have
+// kernels compiled for that size, so the loops have a constant trip count
+// and can be unrolled and vectorized. Other block sizes use generic kernels.
+// exp-16 compares the two
+template <typename T>
+struct BlockKernels {
+    static constexpr uint32_t MIN_SPECIALIZED_BLOCK_SIZE = 8;
+    static constexpr uint32_t MAX_SPECIALIZED_BLOCK_SIZE = 16384;
+
+    // dst[i] = src[i] for all elements of the block
+    void (*copy_)(T* __restrict dst, const T* __restrict src, uint32_t block_size);
+
+    // dst[i] += src[i] for all elements of the block
+    void (*accumulate_)(T* __restrict dst, const T* __restrict src, uint32_t block_size);
+
+    // Returns true iff all elements of the block are zero
+    bool (*is_zero_)(const T* src, uint32_t block_size);
+
+    // Look up the kernels for the given block size in the dispatch table
+    static BlockKernels select(uint32_t block_size);
+
+    // Kernels that work for any block size
+    static BlockKernels generic();
+};
+
+#endif
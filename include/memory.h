@@ -0,0 +1,120 @@
+#ifndef _MEMORY_H_
+#define _MEMORY_H_
+
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <memory>
+#include <vector>
+
+#include <sched.h>
+
+class ThreadPool;
+
+// Large buffers, such as the gradients of a worker, are mapped directly from
+// the kernel so that they can be backed by 2 MiB huge pages and bound to a
+// NUMA node, which saves TLB misses and remote memory traffic for large data.
+// Buffers smaller than a huge page come from the heap as usual
+
+static constexpr size_t HUGE_PAGE_SIZE = 2UL << 20;
+
+enum HugePages {
+    // Regular pages
+    HUGE_PAGES_NONE,
+    // Ask for transparent huge pages, which the kernel may or may not provide
+    HUGE_PAGES_TRANSPARENT,
+    // Use huge pages reserved in advance by the administrator, falling
+    // back to transparent huge pages when none are left
+    HUGE_PAGES_EXPLICIT
+};
+
+// How the calling thread allocates large buffers
+struct MemoryPolicy {
+    HugePages huge_pages_ = HUGE_PAGES_TRANSPARENT;
+
+    // NUMA node to bind buffers to, or -1 to place pages on
+    // the node of the thread that touches them first
+    int node_ = -1;
+};
+
+// Policy of the calling thread, which can be changed at any time
+// and applies to the buffers allocated afterwards
+MemoryPolicy& memory_policy();
+
+// Number of NUMA nodes, 1 if the system does not report them
+int num_memory_nodes();
+
+// Allocate a buffer of the given size according to the policy of the
+// calling thread. Pages of large buffers are touched by the threads of
+// ThreadPool::instance(), so that without a bound node they are spread over
+// the nodes that the pool runs on. Throws std::bad_alloc on failure
+void* allocate_buffer(size_t bytes);
+
+// Free a buffer returned by allocate_buffer with the same size
+void free_buffer(void* buffer, size_t bytes);
+
+// Allocator for std::vector that uses allocate_buffer
+template <typename T>
+struct BufferAllocator {
+    using value_type = T;
+
+    BufferAllocator() = default;
+
+    template <typename U>
+    BufferAllocator(const BufferAllocator<U>&) {
+    }
+
+    T* allocate(size_t n) {
+        if (n > static_cast<size_t>(-1) / sizeof(T)) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(allocate_buffer(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t n) {
+        free_buffer(p, n * sizeof(T));
+    }
+
+    template <typename U>
+    bool operator==(const BufferAllocator<U>&) const {
+        return true;
+    }
+
+    template <typename U>
+    bool operator!=(const BufferAllocator<U>&) const {
+        return false;
+    }
+};
+
+// Element buffers of workers and packets
+template <typename T>
+using Buffer = std::vector<T, BufferAllocator<T>>;
+
+// Pins the calling thread to the CPUs of a NUMA node and binds the buffers
+// it allocates to the same node, until the binding is destroyed. Meanwhile,
+// ThreadPool::instance() of the thread is a pool of its own, whose threads
+// run on the node's CPUs too, so that the loops of simulations and the
+// pages they touch first stay on the node. A negative node leaves
+// everything as it is
+class NodeBinding {
+public:
+    NodeBinding(int node);
+    ~NodeBinding();
+
+    NodeBinding(const NodeBinding&) = delete;
+    NodeBinding& operator=(const NodeBinding&) = delete;
+
+private:
+    const int node_;
+
+    // CPUs and memory node of the thread before the binding
+    cpu_set_t saved_cpus_;
+    bool cpus_saved_;
+    int saved_node_;
+
+    // Pool on the node's CPUs, and the pool of the thread before the binding
+    std::unique_ptr<ThreadPool> pool_;
+    ThreadPool* saved_pool_;
+};
+
+#endif
@@ -0,0 +1,128 @@
+#ifndef _MODEL_H_
+#define _MODEL_H_
+
+#include <cstdint>
+#include <cstdlib>
+#include <istream>
+#include <string>
+#include <vector>
+
+#include "types.h"
+
+// A single tensor of the model. Tensors are listed in the order of the
+// forward pass, so the backward pass produces their gradients in reverse
+struct Tensor {
+    Tensor(const std::string& name, size_t size, timedelta_t backward_time);
+
+    std::string name_;
+
+    // Number of gradient elements in the tensor
+    size_t size_;
+
+    // Time needed to compute the gradients of this tensor
+    // in the backward pass
+    timedelta_t backward_time_;
+};
+
+// A group of tensors whose gradients are allreduced together
+struct Bucket {
+    // Indices of the tensors in the bucket, in the order
+    // in which their gradients become available
+    std::vector<size_t> tensors_;
+
+    // Number of gradient elements in the bucket
+    size_t size_;
+
+    // Time since the start of the backward pass when the gradients
+    // of all tensors in the bucket are available
+    timestamp_t ready_time_;
+};
+
+class Model {
+public:
+    // Parse a model description, one tensor per line:
+    //     <name> <number of elements> <backward time>
+    // Empty lines and lines starting with '#' are ignored
+    static Model parse(std::istream& in);
+
+    void add_tensor(const std::string& name, size_t size, timedelta_t backward_time);
+
+    // Group the tensors into buckets in backward order. A bucket is closed
+    // as soon as it holds at least bucket_size elements, so every tensor
+    // belongs to exactly one bucket
+    std::vector<Bucket> make_buckets(size_t bucket_size) const;
+
+    // Total time of the backward pass
+    timedelta_t backward_time() const;
+
+    // Total number of gradient elements
+    size_t size() const;
+
+    const std::vector<Tensor>& tensors() const;
+
+private:
+    std::vector<Tensor> tensors_;
+};
+
+// Simulates one training iteration of a model in which the allreduce of
+// each bucket starts as soon as the bucket is ready, overlapping the
+// communication with the rest of the backward pass.
+// Allreduces share the aggregator, so they run one at a time in the order
+// in which the buckets become ready
+class BucketedSimulator {
+public:
+    BucketedSimulator(const Model& model,
+                      size_t bucket_size,
+                      workernum_t num_workers,
+                      uint32_t block_size,
+                      uint32_t bf_width);
+
+    // Set the sparsity of the gradients of all buckets
+    void set_sparsity(float sparsity);
+
+    // Seed the data of the buckets, each bucket from seed plus its index,
+    // so that runs with the same seed give the same times
+    void seed(uint32_t seed);
+
+    void run();
+
+    // Time when the allreduce of the last bucket finishes,
+    // or the backward pass finishes, whichever is later
+    uint64_t get_time() const;
+
+    // Time of the backward pass
+    uint64_t get_compute_time() const;
+
+    // Total time spent in allreduce across all buckets
+    uint64_t get_communication_time() const;
+
+    // Communication time that is not hidden behind the backward pass
+    uint64_t get_exposed_time() const;
+
+    const std::vector<Bucket>& buckets() const;
+
+private:
+    const workernum_t num_workers_;
+
+    // Block size, set at construction time
+    const uint32_t block_size_;
+
+    // Block fusion width, set at construction time
+    const uint32_t bf_width_;
+
+    float sparsity_;
+
+    // Seed of the data of the first bucket
+    uint32_t seed_;
+
+    const timedelta_t compute_time_;
+
+    std::vector<Bucket> buckets_;
+
+    // Time when the allreduce of the last bucket finishes
+    uint64_t time_;
+
+    uint64_t communication_time_;
+};
+
+#endif
@@ -0,0 +1,173 @@
+#ifndef _MULTIJOB_H_
+#define _MULTIJOB_H_
+
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <queue>
+#include <vector>
+
+#include "types.h"
+#include "event.h"
+#include "simulator.h"
+
+using jobnum_t = uint32_t;
+
+// Work of a job waiting for a shared resource. Once the resource has
+// spent demand_ on it, event_ happens
+struct Task {
+    jobnum_t job_;
+    Event event_;
+    timedelta_t demand_;
+};
+
+// Decides which job gets a shared resource next
+class SchedulingPolicy {
+public:
+    virtual ~SchedulingPolicy() = default;
+
+    virtual void push(const Task& task) = 0;
+
+    // Remove and return the next task to serve
+    virtual Task pop() = 0;
+
+    virtual bool empty() const = 0;
+};
+
+// Tasks are served in the order in which they became ready
+class FifoPolicy : public SchedulingPolicy {
+public:
+    void push(const Task& task) override;
+    Task pop() override;
+    bool empty() const override;
+
+private:
+    std::deque<Task> tasks_;
+};
+
+// Jobs take turns, one task at a time
+class RoundRobinPolicy : public SchedulingPolicy {
+public:
+    RoundRobinPolicy();
+
+    void push(const Task& task) override;
+    Task pop() override;
+    bool empty() const override;
+
+private:
+    // Ready tasks of each job
+    std::vector<std::deque<Task>> tasks_;
+
+    // The job served last
+    jobnum_t last_;
+
+    size_t size_;
+};
+
+// Jobs get the resource in proportion to their weights, using start-time
+// fair queueing: each task is tagged with the virtual time at which it
+// would start if every job got its share, and the lowest tag is served first
+class WeightedFairPolicy : public SchedulingPolicy {
+public:
+    // weights[j] is the weight of job j
+    WeightedFairPolicy(const std::vector<double>& weights);
+
+    void push(const Task& task) override;
+    Task pop() override;
+    bool empty() const override;
+
+private:
+    const std::vector<double> weights_;
+
+    // Ready tasks of each job, with their start tags
+    std::vector<std::deque<std::pair<double, Task>>> tasks_;
+
+    // Finish tag of the last task of each job
+    std::vector<double> finish_;
+
+    // Virtual time, the start tag of the task served last
+    double virtual_time_;
+
+    size_t size_;
+};
+
+// Several independent collective jobs that share the aggregator's compute
+// and its link. Processing packets and preparing the result run on the
+// aggregator's compute servers, and multicasting the result, or sending it
+// again to a worker that lost it, uses the link, which sends one packet at
+// a time. Whenever a resource frees up, its scheduling policy picks the job
+// to serve next. Workers are not shared
+class MultiJobSimulator {
+public:
+    MultiJobSimulator(SchedulingPolicy& compute_policy,
+                      SchedulingPolicy& link_policy,
+                      uint32_t compute_servers = 1);
+
+    // Add a job that starts at the given time. The simulator must have its
+    // data generated. The job is the next collective of the simulator, as
+    // Simulator::run would run it, on a copy. Returns the job number
+    jobnum_t add_job(const Simulator<>& job, timestamp_t start_time = 0);
+
+    // Run all jobs together, and each job alone to compute its slowdown.
+    // The jobs run on copies, so running again gives the same times
+    void run();
+
+    // Returns true iff every job holds the expected result of its collective
+    // after running together. The jobs must have been prepared for
+    // verification before they were added
+    bool verify() const;
+
+    // Time when the last job finished
+    uint64_t get_time() const;
+
+    // Time from the start to the end of a job when sharing the aggregator
+    uint64_t get_completion_time(jobnum_t job) const;
+
+    // Time from the start to the end of a job when running alone
+    uint64_t get_solo_time(jobnum_t job) const;
+
+    // Completion time when sharing divided by completion time when alone
+    double get_slowdown(jobnum_t job) const;
+
+private:
+    using JobEvent = std::pair<Event, jobnum_t>;
+    using EventQueue = std::priority_queue<JobEvent, std::vector<JobEvent>, std::greater<JobEvent>>;
+
+    // A resource shared by the jobs
+    struct Resource {
+        SchedulingPolicy* policy_;
+        uint32_t servers_;
+        uint32_t busy_;
+    };
+
+    SchedulingPolicy& compute_policy_;
+    SchedulingPolicy& link_policy_;
+    const uint32_t compute_servers_;
+
+    // Jobs as added, before running
+    std::vector<Simulator<>> jobs_;
+    std::vector<timestamp_t> start_times_;
+
+    // Jobs after running together
+    std::vector<Simulator<>> runs_;
+
+    std::vector<uint64_t> completion_times_;
+    std::vector<uint64_t> solo_times_;
+
+    // Simulate the given jobs sharing the resources, returns the
+    // completion time of each job
+    std::vector<uint64_t> simulate(std::vector<Simulator<>>& jobs,
+                                   const std::vector<timestamp_t>& start_times,
+                                   SchedulingPolicy& compute_policy,
+                                   SchedulingPolicy& link_policy) const;
+
+    // Queue a task on a resource, and start it if a server is free
+    void submit(Resource& resource, const Task& task, timestamp_t time, EventQueue& events) const;
+
+    // A task of the resource finished, so start the next one
+    void release(Resource& resource, timestamp_t time, EventQueue& events) const;
+
+    void dispatch(Resource& resource, timestamp_t time, EventQueue& events) const;
+};
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef _PATTERN_H_
+#define _PATTERN_H_
+
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include <random>
+
+// Decides which blocks of the gradients are nonzero. One pattern is
+// shared by all workers of a simulation, so it can correlate their
+// gradients. Before generating masks for a data set, prepare must be
+// called once with the number of blocks (Simulator::generate_data does so)
+class SparsityPattern {
+public:
+    virtual ~SparsityPattern() = default;
+
+    // Draw the state shared by all workers for a data set with
+    // the given number of blocks
+    virtual void prepare(size_t num_blocks);
+
+    // Fill mask with one entry per block, nonzero iff the block is nonzero.
+    // mask.size() is the number of blocks
+    virtual void generate(std::vector<char>& mask, std::mt19937& generator) = 0;
+};
+
+// Each block is zero independently with probability sparsity
+class UniformPattern : public SparsityPattern {
+public:
+    UniformPattern(float sparsity);
+
+    void generate(std::vector<char>& mask, std::mt19937& generator) override;
+
+private:
+    const float sparsity_;
+};
+
+// Block popularity follows a Zipf distribution with the given exponent:
+// the block of rank r is nonzero with probability proportional to 1 / r^exponent,
+// scaled so that on average a fraction sparsity of blocks is zero. The ranking
+// is a random permutation of blocks shared by all workers, so all workers
+// have the same hot blocks
+class ZipfPattern : public SparsityPattern {
+public:
+    ZipfPattern(float sparsity, double exponent, uint32_t seed = std::random_device{}());
+
+    void prepare(size_t num_blocks) override;
+    void generate(std::vector<char>& mask, std::mt19937& generator) override;
+
+private:
+    const float sparsity_;
+    const double exponent_;
+    std::mt19937 generator_;
+
+    // Probability that each block is nonzero
+    // probability_.size() == number of blocks
+    std::vector<double> probability_;
+};
+
+// Nonzero blocks come in bursts: runs of consecutive nonzero blocks have a
+// geometrically distributed length with mean burst_length, and the gaps
+// between them are sized so that on average a fraction sparsity of blocks is zero
+class BurstyPattern : public SparsityPattern {
+public:
+    BurstyPattern(float sparsity, double burst_length);
+
+    void generate(std::vector<char>& mask, std::mt19937& generator) override;
+
+private:
+    const float sparsity_;
+    const double burst_length_;
+};
+
+// Correlates the masks of different workers. A mask drawn from the base
+// pattern is shared by all workers, and each block of a worker's mask is
+// taken from the shared mask with probability correlation, and from an
+// independent draw of the base pattern otherwise. Correlation 0 gives
+// independent workers, correlation 1 gives identical masks, and the
+// fraction of nonzero blocks is the same as in the base pattern
+class CorrelatedPattern : public SparsityPattern {
+public:
+    CorrelatedPattern(SparsityPattern& base,
+                      float correlation,
+                      uint32_t seed = std::random_device{}());
+
+    void prepare(size_t num_blocks) override;
+    void generate(std::vector<char>& mask, std::mt19937& generator) override;
+
+private:
+    SparsityPattern& base_;
+    const float correlation_;
+    std::mt19937 generator_;
+
+    // Mask shared by all workers
+    std::vector<char> shared_;
+};
+
+#endif
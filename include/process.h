@@ -0,0 +1,235 @@
+#ifndef _PROCESS_H_
+#define _PROCESS_H_
+
+#include <cstdint>
+#include <cstdlib>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <queue>
+#include <vector>
+
+#include "types.h"
+
+// Simulation processes are coroutines that run on a Scheduler in simulated
+// time. A process is written as a straight-line protocol: it waits for a
+// delay, for a message in a Mailbox, or for the other processes at a
+// Barrier, and the scheduler resumes it at the right time. Resuming a
+// process costs one push and one pop of the scheduler's queue, like an
+// Event does, and the coroutine frames come from a FramePool, so that
+// spawning a process does not go to the heap either
+
+// Recycles coroutine frames of the calling thread. Frames are rounded up to
+// a multiple of FRAME_ALIGNMENT, and freed frames are kept in one list per
+// size, up to MAX_POOLED_FRAME_SIZE. Larger frames come from the heap
+namespace FramePool {
+    static constexpr size_t FRAME_ALIGNMENT = 64;
+    static constexpr size_t MAX_POOLED_FRAME_SIZE = 4096;
+
+    void* allocate(size_t bytes);
+    void deallocate(void* frame, size_t bytes);
+}
+
+class Scheduler;
+
+// Handle of a process, returned by the process function. The process does
+// not run until it is given to Scheduler::spawn, which takes it over
+class Process {
+public:
+    struct promise_type {
+        // Scheduler the process was spawned on
+        Scheduler* scheduler_ = nullptr;
+
+        // Processes resumed at the same time run in increasing priority
+        uint64_t priority_ = 0;
+
+        // Neighbours in the scheduler's list of live processes
+        promise_type* prev_ = nullptr;
+        promise_type* next_ = nullptr;
+
+        Process get_return_object();
+        std::suspend_always initial_suspend() noexcept;
+
+        // Leaves the list of live processes and frees the frame
+        struct FinalAwaiter {
+            bool await_ready() noexcept;
+            void await_suspend(std::coroutine_handle<promise_type> handle) noexcept;
+            void await_resume() noexcept;
+        };
+        FinalAwaiter final_suspend() noexcept;
+
+        void return_void();
+
+        // The exception is rethrown by Scheduler::run
+        void unhandled_exception();
+
+        static void* operator new(size_t bytes);
+        static void operator delete(void* frame, size_t bytes);
+    };
+
+    Process(Process&& other);
+    Process& operator=(Process&& other) = delete;
+    ~Process();
+
+private:
+    friend class Scheduler;
+
+    explicit Process(std::coroutine_handle<promise_type> handle);
+
+    std::coroutine_handle<promise_type> handle_;
+};
+
+// Handle that awaiters resume processes through
+using ProcessHandle = std::coroutine_handle<Process::promise_type>;
+
+// Runs processes in the order of simulated time. Processes resumed at the
+// same time run in the order of their priorities, and then in the order
+// in which they were scheduled
+class Scheduler {
+public:
+    Scheduler(timestamp_t start = 0);
+
+    // Destroys the processes that never finished
+    ~Scheduler();
+
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+
+    // Start a process at the current time, with the given priority
+    void spawn(Process process, uint64_t priority = 0);
+
+    // Resume processes until none can make progress. Rethrows the first
+    // exception that escapes a process
+    void run();
+
+    // Current simulated time, which is the time of the last resumption
+    // once run returns
+    timestamp_t now() const;
+
+    // Resume a suspended process at the given time, which must not be
+    // in the past
+    void wake(ProcessHandle handle, timestamp_t time);
+
+    // Awaitable that resumes the process delta later. A zero delay
+    // does not suspend at all
+    struct Delay {
+        Scheduler& scheduler_;
+        const timedelta_t delta_;
+
+        bool await_ready() const noexcept;
+        void await_suspend(ProcessHandle handle) const;
+        void await_resume() const noexcept;
+    };
+    Delay delay(timedelta_t delta);
+
+private:
+    friend struct Process::promise_type;
+    friend struct Process::promise_type::FinalAwaiter;
+
+    struct Wakeup {
+        timestamp_t time_;
+        // Priority of the process, and the order in which
+        // wakeups were scheduled, to break ties
+        uint64_t priority_;
+        uint64_t order_;
+        ProcessHandle handle_;
+
+        bool operator>(const Wakeup& other) const;
+    };
+
+    std::priority_queue<Wakeup, std::vector<Wakeup>, std::greater<Wakeup>> wakeups_;
+    timestamp_t time_;
+    uint64_t num_scheduled_;
+
+    // Processes that have been spawned and not finished yet
+    Process::promise_type* live_;
+
+    // First exception that escaped a process
+    std::exception_ptr exception_;
+};
+
+// Queue of messages for one receiving process. Messages are delivered when
+// they are put, so a message that takes time to arrive is put by a process
+// that waits for that time first
+template <typename M>
+class Mailbox {
+public:
+    Mailbox(Scheduler& scheduler) :
+        scheduler_(scheduler) {
+    }
+
+    Mailbox(const Mailbox&) = delete;
+    Mailbox& operator=(const Mailbox&) = delete;
+
+    // Deliver a message, resuming the receiver now if it waits for one
+    void put(M message) {
+        messages_.push_back(std::move(message));
+        if (receiver_) {
+            scheduler_.wake(receiver_, scheduler_.now());
+            receiver_ = nullptr;
+        }
+    }
+
+    // Awaitable that returns the oldest message, waiting for one if
+    // there is none. Only one process may receive from a mailbox
+    struct Receive {
+        Mailbox& mailbox_;
+
+        bool await_ready() const noexcept {
+            return !mailbox_.messages_.empty();
+        }
+
+        void await_suspend(ProcessHandle handle) const noexcept {
+            mailbox_.receiver_ = handle;
+        }
+
+        M await_resume() const {
+            M message = std::move(mailbox_.messages_.front());
+            mailbox_.messages_.pop_front();
+            return message;
+        }
+    };
+    Receive receive() {
+        return Receive{*this};
+    }
+
+    // Number of messages that have not been received yet
+    size_t size() const {
+        return messages_.size();
+    }
+
+private:
+    Scheduler& scheduler_;
+    std::deque<M> messages_;
+    ProcessHandle receiver_;
+};
+
+// Synchronizes a fixed number of processes. Each of them waits until all
+// have arrived, and then all continue at the time of the last arrival.
+// The barrier can be used again right away
+class Barrier {
+public:
+    Barrier(Scheduler& scheduler, uint32_t count);
+
+    Barrier(const Barrier&) = delete;
+    Barrier& operator=(const Barrier&) = delete;
+
+    struct Arrive {
+        Barrier& barrier_;
+
+        bool await_ready() const noexcept;
+        // The last process to arrive continues without suspending
+        bool await_suspend(ProcessHandle handle) const;
+        void await_resume() const noexcept;
+    };
+    Arrive arrive_and_wait();
+
+private:
+    Scheduler& scheduler_;
+    const uint32_t count_;
+
+    // Processes of the current phase that wait for the others
+    std::vector<ProcessHandle> waiting_;
+};
+
+#endif
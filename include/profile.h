@@ -0,0 +1,70 @@
+#ifndef _PROFILE_H_
+#define _PROFILE_H_
+
+// Profiling of hot paths, enabled with PROF=1. PROFILE_SCOPE(name) measures
+// the time from its declaration to the end of the enclosing scope, and a
+// table of all scopes is printed to stderr when the program exits. Times
+// include the time of nested scopes. Without PROF=1, PROFILE_SCOPE
+// expands to nothing
+
+#ifdef PROFILING
+
+#include <cstdint>
+#include <cstdlib>
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+class Profiler {
+public:
+    // Identifier of the scope with the given name, assigned on first use
+    static size_t id(const char* name);
+
+    // Record one execution of a scope
+    static void record(size_t id, uint64_t ticks);
+
+    // Current time, in cycles where the time stamp counter
+    // is available and in nanoseconds otherwise
+    static uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+};
+
+class ProfileScope {
+public:
+    ProfileScope(size_t id) :
+        id_(id),
+        start_(Profiler::now()) {
+    }
+
+    ~ProfileScope() {
+        Profiler::record(id_, Profiler::now() - start_);
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    const size_t id_;
+    const uint64_t start_;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) \
+    static const size_t PROFILE_CONCAT(profile_id_, __LINE__) = Profiler::id(name); \
+    ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(PROFILE_CONCAT(profile_id_, __LINE__))
+
+#else
+
+#define PROFILE_SCOPE(name)
+
+#endif
+
+#endif
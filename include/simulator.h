@@ -2,27 +2,170 @@
 #define _SIMULATOR_H_
 
 #include <queue>
+#include <deque>
 
 #include "event.h"
 #include "aggregator.h"
 #include "worker.h"
+#include "pattern.h"
+#include "element.h"
+#include "sparsifier.h"
+#include "process.h"
 
+// T is the element type of the gradients
+template <typename T = float>
 class Simulator {
+    // Handles the events of several simulations at once, passing the work
+    // of their aggregators through shared resources
+    friend class MultiJobSimulator;
+
     using EventQueue = std::priority_queue<Event, std::vector<Event>, std::greater<Event>>;
 
+    // A part of the simulation that processes its events independently
+    // of the others within a window
+    struct LogicalProcess {
+        LogicalProcess();
+
+        EventQueue events_;
+
+        // Events for other logical processes, delivered
+        // at the end of the window
+        std::vector<Event> outbox_;
+
+        // Time of the last processed event
+        uint64_t time_;
+
+        uint64_t computation_time_;
+        uint64_t network_time_;
+    };
+
 public:
-    Simulator(workernum_t num_workers, uint32_t block_size, uint32_t bf_width);
+    Simulator(workernum_t num_workers,
+              uint32_t block_size,
+              uint32_t bf_width,
+              Collective collective = ALLREDUCE,
+              Protocol protocol = CHAINING);
+    // Seed the data generators of all workers, for reproducible data
+    void seed(uint32_t seed);
+    // Generate the gradients of all workers and split them into shards.
+    // For all-gather and broadcast, only the data that a worker
+    // contributes is kept
     void generate_data(size_t size, uint32_t block_size, float sparsity);
+    void generate_data(size_t size, uint32_t block_size, SparsityPattern& pattern);
+
+    // Give a worker sparse gradients in coordinate or compressed sparse row
+    // format, see Worker::set_sparse_data. Every worker must get data of
+    // the same size
+    void set_sparse_data(workernum_t worker,
+                         size_t size,
+                         const std::vector<uint64_t>& indices,
+                         const std::vector<T>& values);
+    void set_sparse_data(workernum_t worker,
+                         size_t rows,
+                         size_t cols,
+                         const std::vector<uint64_t>& row_ptr,
+                         const std::vector<uint64_t>& col_idx,
+                         const std::vector<T>& values);
+
+    // Sparsify the gradients of every worker before each run. With error
+    // feedback, what a worker drops is added back to its next gradients
+    void set_sparsifier(const Sparsifier& sparsifier);
+
+    // Apply the sparsifiers to the current gradients now, which run does
+    // otherwise. Useful to compute the reference from sparsified gradients.
+    // Returns true iff any gradients changed
+    bool sparsify();
+
+    // Spread the loops of workers and the aggregator over the blocks of a
+    // fused packet, like copying and aggregating blocks and searching for
+    // the next nonzero blocks, over ThreadPool::instance() when one step
+    // touches at least threshold elements. Columns are independent, so the
+    // results are the same as with serial loops. Zero always runs them in
+    // parallel. Steps of run_parallel and of runs in a thread pool stay serial
+    void set_parallel_threshold(size_t threshold);
+
+    // With the chaining protocol, columns of the fused packet run dry at
+    // different times, and late rounds carry mostly invalid blocks. In
+    // adaptive width mode, the per-column overhead of packets is charged
+    // only for the columns that still have blocks to aggregate, as if
+    // exhausted columns were compacted out of the packet. The simulator
+    // itself visits the remaining columns only in either mode
+    void set_adaptive_width(bool adaptive);
+
+    // Aggregate in a fixed pool of num_slots slots of slot_size elements
+    // each, like a programmable switch does, see Aggregator::set_slot_pool.
+    // Workers send the blocks that did not find free slots again in the
+    // next round. Zero slots give the aggregator unlimited memory again
+    void set_slot_pool(uint32_t num_slots, uint32_t slot_size);
+
+    // Lose each packet between a worker and the aggregator with the given
+    // probability, in either direction. Workers that do not receive the
+    // result of a round within the timeout send their packet again, and the
+    // aggregator sends the result again to workers that ask for an earlier
+    // round. Losses are drawn from one generator per link and direction,
+    // derived from seed. Only run simulates losses
+    void set_loss(double probability, timedelta_t timeout = DEFAULT_TIMEOUT, uint32_t seed = 0);
+
+    // Change the loss probability of the link of one worker,
+    // after set_loss
+    void set_link_loss(workernum_t worker, double probability);
+
+    // Run the collective on the current gradients. Running again after
+    // new data has been generated starts another collective, and time
+    // keeps advancing from the end of the previous one
     void run();
+
+    // Run the simulation as a conservative parallel discrete-event simulation.
+    // Workers are partitioned over num_threads threads, each with its own
+    // event queue, and the aggregator has a queue of its own. Time advances
+    // in windows as long as the link latency, and all queues process the
+    // events of a window in parallel, because no packet sent within a window
+    // can arrive before its end. Results are identical to run()
+    void run_parallel(uint32_t num_threads);
+
+    // Run the simulation with each worker and the aggregator written as a
+    // straight-line process, see process.h, instead of through the event
+    // handlers. Results are identical to run(). Only run simulates losses
+    void run_processes();
+
     uint64_t get_time();
 
+    // Compute the expected result of the collective from the generated data.
+    // Must be called after generate_data or set_sparse_data and before run
+    void prepare_verification();
+
+    // Returns true iff every worker holds the expected result. With
+    // reduce-scatter, only the shard of each worker is checked.
+    // Must be called after prepare_verification and run
+    bool verify() const;
+
+    // Gradients of a worker, which hold the result once the run finished
+    const Buffer<T>& gradients(workernum_t worker) const;
+
+    // Number of aggregation rounds in the last run
+    uint64_t get_rounds() const;
+
+    // Average number of workers sending a packet in each round
+    double get_mean_participation() const;
+
+    // Number of valid blocks that were aggregated in the last run
+    uint64_t get_blocks() const;
+
+    // Number of valid blocks that found no free slot in the last run
+    uint64_t get_rejected_blocks() const;
+
+    // Number of packets lost, and of packets that workers sent
+    // again after a timeout, in the last run
+    uint64_t get_lost_packets() const;
+    uint64_t get_retransmissions() const;
+
 #ifndef DEBUGGING
     private:
 #else
     public:
 #endif
-    Aggregator aggregator_;
-    std::vector<Worker> workers_;
+    Aggregator<T> aggregator_;
+    std::vector<Worker<T>> workers_;
 
     // Block size, set at construction time
     const uint32_t block_size_;
@@ -30,10 +173,76 @@ public:
     // Block fusion width, set at construction time
     const uint32_t bf_width_;
 
+    // Collective operation, set at construction time
+    const Collective collective_;
+
     // Global time
     uint64_t time_;
 
+    // True iff links can lose packets, see set_loss
+    bool lossy_;
+    timedelta_t timeout_;
+    uint32_t loss_seed_;
+
+    uint64_t lost_packets_;
+    uint64_t retransmissions_;
+
     EventQueue events_;
+
+    // Number of logical processes that workers are partitioned into,
+    // 0 when everything runs in a single logical process
+    uint32_t num_partitions_;
+
+    // Logical process that owns the given event: the aggregator's process
+    // is 0, and the worker partitions are numbered from 1
+    size_t owner(const Event& e) const;
+
+    // First worker owned by the given logical process. The workers
+    // of a logical process are [first_worker(lp), first_worker(lp + 1))
+    workernum_t first_worker(size_t lp) const;
+
+    // Process a single event, scheduling the resulting events. Events that
+    // concern all workers (INIT_EVENT and AGGREGATOR_SEND) are batched:
+    // a single event covers all workers of the logical process
+    void handle(const Event& e, std::vector<LogicalProcess>& lps, size_t lp);
+
+    // Let a worker prepare its packet, and schedule sending it
+    void prepare(Worker<T>& worker, std::vector<LogicalProcess>& lps, size_t lp);
+
+    // Schedule an event created by the given logical process
+    void schedule(const Event& e, std::vector<LogicalProcess>& lps, size_t lp);
+
+    // Sparsify the gradients and set up the event queue for a run
+    void start();
+
+    // Protocols of a worker and of the aggregator, run by run_processes.
+    // A worker gets the time to process each result in its inbox, and the
+    // aggregator gets the ID of each worker whose packet has been processed
+    Process worker_process(Scheduler& scheduler,
+                           Worker<T>& worker,
+                           Mailbox<timedelta_t>& inbox,
+                           Mailbox<workernum_t>& aggregator_inbox,
+                           LogicalProcess& lp);
+    Process aggregator_process(Scheduler& scheduler,
+                               Mailbox<workernum_t>& inbox,
+                               std::deque<Mailbox<timedelta_t>>& worker_inboxes,
+                               LogicalProcess& lp);
+
+    // Collect the global time and statistics from all logical processes
+    void finish(const std::vector<LogicalProcess>& lps);
+
+    // First block of the given worker's shard, for data with the given
+    // number of blocks. The shard of worker w is
+    // [shard_begin(w, n), shard_begin(w + 1, n))
+    blocknum_t shard_begin(workernum_t worker, size_t num_blocks) const;
+
+    // Assign a worker that got new sparse data its shard
+    void set_shard(Worker<T>& worker);
+
+    // Expected result of the collective, computed in double precision,
+    // empty unless prepare_verification has been called since the data
+    // last changed
+    std::vector<double> reference_;
 };
 
 #endif
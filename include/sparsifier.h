@@ -0,0 +1,46 @@
+#ifndef _SPARSIFIER_H_
+#define _SPARSIFIER_H_
+
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include "memory.h"
+
+// Block-level sparsification of a worker's gradients before they are sent.
+// Blocks are ranked by their squared L2 norm, and only the selected blocks
+// are kept, the rest are zeroed. With error feedback, the dropped values
+// are kept in a residual and added to the gradients of the next iteration,
+// so that nothing is lost for good
+class Sparsifier {
+public:
+    // Keep the k blocks with the largest norm
+    static Sparsifier top_k(size_t k, bool error_feedback = true);
+
+    // Keep the blocks whose L2 norm is at least the threshold
+    static Sparsifier threshold(double threshold, bool error_feedback = true);
+
+    // Sparsify gradients in place. With error feedback, the residual is
+    // first added to the gradients, and then replaced with the dropped
+    // values. residual must be empty or as large as gradients
+    template <typename T>
+    void apply(Buffer<T>& gradients, Buffer<T>& residual, uint32_t block_size) const;
+
+private:
+    enum Mode {
+        TOP_K,
+        THRESHOLD
+    };
+
+    Sparsifier(Mode mode, size_t k, double threshold, bool error_feedback);
+
+    Mode mode_;
+    size_t k_;
+    double threshold_;
+    bool error_feedback_;
+
+    // Marks the blocks to keep, given the squared norm of each block
+    void select(const std::vector<double>& norms, std::vector<char>& keep) const;
+};
+
+#endif
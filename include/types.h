@@ -11,5 +11,42 @@ using timestamp_t = uint64_t;
 static constexpr blocknum_t BLOCK_INF = static_cast<blocknum_t>(-1);
 static constexpr workernum_t WORKER_ALL = static_cast<workernum_t>(-1);
 static constexpr timedelta_t TIME_NOW = static_cast<timedelta_t>(0);
+static constexpr timestamp_t TIME_INF = static_cast<timestamp_t>(-1);
+
+// Fixed latency of sending a packet over any link, which is also the minimum
+// time between sending and receiving a packet
+static constexpr timedelta_t LINK_LATENCY = static_cast<timedelta_t>(1000);
+
+// Default time after which a worker that has not received the result
+// of its round sends its packet again, when packets can be lost
+static constexpr timedelta_t DEFAULT_TIMEOUT = 20 * LINK_LATENCY;
+
+// Version of the timing model. Must be bumped whenever the time taken by
+// any step changes, which invalidates cached sweep results
+static constexpr uint32_t COST_MODEL_VERSION = 1;
+
+// Collective operation performed by a simulation. The data is split into one
+// contiguous shard of blocks per worker
+enum Collective {
+    // Every worker gets the sum of all gradients
+    ALLREDUCE,
+    // Every worker gets the sum of all gradients in its own shard only
+    REDUCE_SCATTER,
+    // Every worker contributes its own shard, and gets all shards
+    ALL_GATHER,
+    // Worker 0 contributes all of its gradients, and every worker gets them
+    BROADCAST
+};
+
+// How workers and the aggregator agree on the blocks of each round
+enum Protocol {
+    // Every block carries the ID of the sender's next nonzero block in its
+    // fusion column, and the aggregator asks for the smallest one next
+    CHAINING,
+    // Workers first send a bitmap of their nonzero blocks. The aggregator
+    // ORs the bitmaps and schedules all rounds up front, packing the
+    // nonzero blocks of the union bf_width per round regardless of column
+    BITMAP
+};
 
 #endif
@@ -1,6 +1,15 @@
 #ifndef _UTILS_H_
 #define _UTILS_H_
 
+#include <cstdlib>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <algorithm>
+
 #ifdef DEBUGGING
     #define DEBUG(x) do { x } while (false)
 #else
@@ -15,4 +24,90 @@
     #define verbose_print(x) do {  } while (false)
 #endif
 
+// Fixed set of threads for data-parallel loops
+class ThreadPool {
+public:
+    // Creates a pool in which num_threads threads, including
+    // the calling thread, run the loops
+    ThreadPool(unsigned num_threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Call f(i) for all i in [0, n), spread over the threads of the pool,
+    // and return once all calls finished. Calls made from inside another
+    // loop of the pool run serially on the calling thread
+    void parallel_for(size_t n, const std::function<void(size_t)>& f);
+
+    // Number of threads running the loops, including the calling thread
+    unsigned size() const;
+
+    // Pool of the calling thread: the one given to set_instance, or
+    // else the pool shared by the whole program, with one thread per
+    // hardware thread
+    static ThreadPool& instance();
+
+    // Make instance() return pool in the calling thread, or the shared
+    // pool if pool is nullptr. Returns the pool it returned before,
+    // nullptr for the shared one
+    static ThreadPool* set_instance(ThreadPool* pool);
+
+private:
+    void work();
+    void run_tasks();
+
+    std::vector<std::thread> threads_;
+
+    // Serializes loops started from different threads
+    std::mutex loop_mutex_;
+
+    std::mutex mutex_;
+    std::condition_variable start_;
+    std::condition_variable done_;
+
+    // Incremented for every loop, so that threads can tell a new loop
+    // from a spurious wakeup
+    uint64_t generation_;
+    bool stop_;
+
+    // The current loop
+    const std::function<void(size_t)>* task_;
+    size_t num_tasks_;
+    std::atomic<size_t> next_task_;
+
+    // How many pool threads are still working on the current loop
+    unsigned num_busy_;
+};
+
+// Elements that a single step of a worker or the aggregator must touch
+// before its loops over fusion columns are spread over ThreadPool::instance()
+static constexpr size_t DEFAULT_PARALLEL_THRESHOLD = 1UL << 20;
+
+// Elements touched by one task of such a loop, at least
+static constexpr size_t PARALLEL_TASK_WORK = 1UL << 16;
+
+// Call f(k) for all k in [0, n), where each call touches work elements and
+// no two calls touch the same ones. If all calls together touch at least
+// threshold elements, contiguous ranges of calls run as tasks of
+// ThreadPool::instance(). Each call does the same either way, so the
+// results do not depend on the threshold
+template <typename F>
+void parallel_for_work(size_t n, size_t work, size_t threshold, const F& f) {
+    if (n * work < threshold || n <= 1) {
+        for (size_t k = 0; k != n; ++k) {
+            f(k);
+        }
+        return;
+    }
+    const size_t calls_per_task = std::max<size_t>(1, PARALLEL_TASK_WORK / std::max<size_t>(1, work));
+    const size_t num_tasks = (n + calls_per_task - 1) / calls_per_task;
+    ThreadPool::instance().parallel_for(num_tasks, [&f, n, calls_per_task](size_t task) {
+        const size_t end = std::min(n, (task + 1) * calls_per_task);
+        for (size_t k = task * calls_per_task; k != end; ++k) {
+            f(k);
+        }
+    });
+}
+
 #endif
@@ -5,24 +5,104 @@
 #include <cstdlib>
 #include <vector>
 #include <random>
+#include <memory>
+#include <optional>
 
 #include "types.h"
 #include "event.h"
 #include "block.h"
+#include "pattern.h"
+#include "element.h"
+#include "kernels.h"
+#include "sparsifier.h"
+#include "bitmap.h"
 
+template <typename T>
 class Aggregator;
 
+// T is the element type of the gradients
+template <typename T = float>
 class Worker {
 public:
     const workernum_t id_;
 
-    Worker(workernum_t id, uint32_t block_size, uint32_t bf_width);
+    Worker(workernum_t id,
+           uint32_t block_size,
+           uint32_t bf_width,
+           Collective collective = ALLREDUCE,
+           Protocol protocol = CHAINING);
+
+    // Seed the random number generator used to generate gradients
+    void seed(uint32_t seed);
 
     // Generate gradients with a given number of elements and a given sparsity
     void generate_data(size_t size, uint32_t block_size, float sparsity);
 
-    // Copy the packet from the aggregator to the worker
-    void recv_packet(const Packet& packet);
+    // Generate gradients with a given number of elements, with nonzero
+    // blocks chosen by a prepared sparsity pattern
+    void generate_data(size_t size, uint32_t block_size, SparsityPattern& pattern);
+
+    // Take sparse gradients with a given number of elements in coordinate
+    // format: element indices[k] has value values[k]. Indices may come in
+    // any order, and repeated indices are summed. The entries are bucketed
+    // into blocks and fusion columns directly, without building dense
+    // gradients, and every block with an entry is sent. The result of the
+    // collective is still written to gradients()
+    void set_sparse_data(size_t size,
+                         const std::vector<uint64_t>& indices,
+                         const std::vector<T>& values);
+
+    // Take sparse gradients of a rows x cols row-major matrix in compressed
+    // sparse row format: the entries of row r are [row_ptr[r], row_ptr[r + 1])
+    // of col_idx and values
+    void set_sparse_data(size_t rows,
+                         size_t cols,
+                         const std::vector<uint64_t>& row_ptr,
+                         const std::vector<uint64_t>& col_idx,
+                         const std::vector<T>& values);
+
+    // Add the worker's input gradients in [begin, end) to dst[begin, end).
+    // Must be called before the collective runs, which overwrites gradients
+    void add_input(double* dst, size_t begin, size_t end) const;
+
+    // Assign the blocks [begin, end) to this worker. For all-gather and
+    // broadcast, the worker contributes only these blocks, so the rest of
+    // its gradients are cleared. For reduce-scatter, the worker keeps only
+    // these blocks of the result
+    void set_shard(blocknum_t begin, blocknum_t end);
+
+    // Returns true iff the block is in this worker's shard
+    bool owns(blocknum_t block) const;
+
+    // Sparsify the gradients before each collective, keeping the
+    // sparsifier's residual across collectives
+    void set_sparsifier(const Sparsifier& sparsifier);
+
+    // Apply the sparsifier to the current gradients, unless there is none
+    // or it has been applied already. Returns true iff it was applied
+    bool sparsify();
+
+    // Start a collective on the current gradients, sparsifying them if needed.
+    // With the bitmap protocol, this also finds the nonzero blocks.
+    // Returns the time until the worker can prepare its first packet
+    timedelta_t start();
+
+    // Receive the packet multicast by the aggregator. The packet is shared
+    // by all workers and held until it has been processed
+    void recv_packet(const std::shared_ptr<const Packet<T>>& packet);
+
+    // Receive the schedule that the aggregator multicasts in response to
+    // the bitmaps: the blocks of all rounds, bf_width_ per round
+    void recv_schedule(const std::shared_ptr<const std::vector<blocknum_t>>& schedule);
+
+    // Spread the loops over the blocks of a packet over ThreadPool::instance()
+    // when a step touches at least threshold elements, see parallel_for_work
+    void set_parallel_threshold(size_t threshold);
+
+    // Charge the per-column overhead of packets for the columns that still
+    // have blocks to aggregate only, rather than for all bf_width_ columns,
+    // as if the fused packet were compacted when columns run dry
+    void set_adaptive_width(bool adaptive);
 
     // Process the response from the aggregator
     timedelta_t process_response();
@@ -31,7 +111,38 @@ public:
     timedelta_t prepare_to_send();
 
     // Send the packet to the aggregator
-    timedelta_t send(Aggregator& agg);
+    timedelta_t send(Aggregator<T>& agg);
+
+    // Drop each packet on this worker's link to and from the aggregator
+    // with the given probability, drawn from generators seeded with seed
+    void set_loss(double probability, uint32_t seed);
+
+    // Draw whether the packet now arriving at the aggregator,
+    // or at this worker, is lost
+    bool uplink_lost();
+    bool downlink_lost();
+
+    // Number of results received so far, which is the sequence number
+    // of the round that the worker takes part in
+    uint64_t get_seq() const;
+
+    // Returns true iff the worker still waits for the result of round seq
+    bool waiting(uint64_t seq) const;
+
+    // Returns true iff the worker received the results of all rounds
+    bool finished() const;
+
+    // Returns true iff the last prepared packet carries blocks or a bitmap,
+    // so that the aggregator has to take it into account
+    bool has_payload() const;
+
+    // Time to send the last prepared packet again. Without payload, only
+    // the header is sent, which asks the aggregator for the result
+    timedelta_t resend_time() const;
+
+    // Worker gradients, which hold the result once the collective finished.
+    // With sparse input, all zeros until then
+    const Buffer<T>& gradients() const;
 
 #ifndef DEBUGGING
 private:
@@ -42,7 +153,30 @@ public:
     std::mt19937 generator_;
 
     // Worker gradients
-    std::vector<float> gradients_;
+    Buffer<T> gradients_;
+
+    // True iff the input is sparse. Then, gradients_ only receives the
+    // result, and the input is in the sparse_ members
+    bool sparse_;
+
+    // Nonzero blocks of each fusion column, in increasing order, and
+    // where their elements start in sparse_values_
+    // sparse_blocks_.size() == sparse_offsets_.size() == bf_width_
+    std::vector<std::vector<blocknum_t>> sparse_blocks_;
+    std::vector<std::vector<size_t>> sparse_offsets_;
+
+    // Elements of the nonzero blocks, block by block
+    Buffer<T> sparse_values_;
+
+    // Sparsification stage, if any, and the values it dropped so far
+    std::optional<Sparsifier> sparsifier_;
+    Buffer<T> residual_;
+
+    // True iff the sparsifier has been applied to the current gradients
+    bool sparsified_;
+
+    // Time spent sparsifying, charged when the collective starts
+    timedelta_t sparsify_time_;
 
     // Aggregation block size, set at construction time
     const uint32_t block_size_;
@@ -50,6 +184,20 @@ public:
     // Block fusion width, set at construction time
     const uint32_t bf_width_;
 
+    // Loops over a block, specialized for the block size
+    const BlockKernels<T> kernels_;
+
+    // Collective operation, set at construction time
+    const Collective collective_;
+
+    // Protocol, set at construction time
+    const Protocol protocol_;
+
+    // This worker's shard is the blocks [shard_begin_, shard_end_),
+    // all blocks unless set_shard is called
+    blocknum_t shard_begin_;
+    blocknum_t shard_end_;
+
     // The next nonzero blocks for each fused block in a packet
     // next_nonzero_.size() == bf_width_
     std::vector<blocknum_t> next_nonzero_;
@@ -58,15 +206,68 @@ public:
     // next_agg_.size() == bf_width_
     std::vector<blocknum_t> next_agg_;
 
-    // Slot for receiving a packet from the aggregator
-    Packet recv_packet_;
+    // Fusion columns that still have blocks to aggregate, in increasing
+    // order. With the chaining protocol, a column is dropped once the
+    // aggregator requests no more blocks in it, and the loops over the
+    // packet only visit the remaining columns
+    std::vector<uint32_t> active_;
+
+    // True iff the per-column overhead is charged for active_ only
+    bool adaptive_width_;
+
+    // Elements that a step must touch to run its loops over blocks in parallel
+    size_t parallel_threshold_;
+
+    // Columns whose blocks are copied in the current step
+    std::vector<uint32_t> copied_;
+
+    // Packet received from the aggregator, shared with other workers
+    std::shared_ptr<const Packet<T>> recv_packet_;
 
     // Slot for sending a packet to the aggregator
-    Packet send_packet_;
+    Packet<T> send_packet_;
+
+    // With the bitmap protocol, the nonzero blocks of this worker
+    Bitmap bitmap_;
+
+    // With the bitmap protocol, the blocks of all rounds, shared by all
+    // workers, and the next round to send
+    std::shared_ptr<const std::vector<blocknum_t>> schedule_;
+    uint64_t round_;
+
+    // With the bitmap protocol, true iff the worker received the schedule
+    bool negotiated_;
+
+    // Sequence number of the round that the worker takes part in, and
+    // whether its result has been received but not processed yet
+    uint64_t seq_;
+    bool received_;
+
+    // Probability of losing a packet on the link, and the generators
+    // that decide it for each direction
+    double loss_probability_;
+    std::mt19937 uplink_generator_;
+    std::mt19937 downlink_generator_;
 
     // Find the next non-zero block for each block in a fused packet,
     // to be called after process_response
     std::vector<blocknum_t> find_nonzero() const;
+
+    // Bitmap protocol counterpart of prepare_to_send
+    timedelta_t prepare_scheduled();
+
+    // Time to prepare the next packet with the bitmap protocol, which only
+    // copies the worker's blocks of the next round, without lookahead
+    timedelta_t scheduled_prepare_time() const;
+
+    // Elements of an input block, or nullptr if a sparse input has
+    // no entries in it
+    const T* input_block(blocknum_t block) const;
+
+    // Take sparse gradients with num_entries entries, where entry(k)
+    // returns the index and the value of entry k
+    template <typename F>
+    void ingest(size_t size, size_t num_entries, F entry);
 };
 
 #endif
@@ -1,65 +1,110 @@
 #include <stdexcept>
 #include <cassert>
 #include <iostream>
+#include <atomic>
+#include <algorithm>
 
 #include "aggregator.h"
 #include "worker.h"
 #include "utils.h"
+#include "profile.h"
 
 extern uint64_t computation_time;
 extern uint64_t network_time;
 
-Aggregator::Aggregator(workernum_t num_workers, uint32_t block_size, uint32_t bf_width) :
+template <typename T>
+Aggregator<T>::Aggregator(workernum_t num_workers,
+                       uint32_t block_size,
+                       uint32_t bf_width,
+                       Collective collective,
+                       Protocol protocol) :
     num_workers_(num_workers),
     num_received_(0),
     num_to_receive_(num_workers_),
-    num_sent_(0),
+    num_rounds_(0),
+    num_packets_(0),
+    num_blocks_(0),
     block_size_(block_size),
     bf_width_(bf_width),
-    send_packet_(block_size_, bf_width_) {
-    for (size_t i = 0; i != num_workers_; ++i) {
-        recv_packets_.push_back(Packet(block_size_, bf_width_));
-    }
+    kernels_(BlockKernels<T>::select(block_size)),
+    collective_(collective),
+    protocol_(protocol),
+    adaptive_width_(false),
+    parallel_threshold_(DEFAULT_PARALLEL_THRESHOLD),
+    num_slots_(0),
+    slot_size_(0),
+    slots_per_block_(0),
+    slots_used_(0),
+    slot_state_(bf_width_, SLOT_NONE),
+    num_rejected_(0),
+    send_packet_(block_size_, bf_width_),
+    multicast_packet_(std::make_shared<Packet<T>>(block_size_, bf_width_)),
+    multicast_valid_blocks_(0),
+    multicast_columns_(bf_width_),
+    negotiating_(protocol == BITMAP),
+    bitmaps_(num_workers),
+    round_(0),
+    multicast_schedule_(false),
+    schedule_bytes_(0),
+    seq_(0),
+    lossy_(false) {
+    next_.resize(static_cast<size_t>(bf_width_) * num_workers_);
+    std::fill(next_.begin(), next_.end(), BLOCK_INF);
     min_next_.resize(bf_width_);
     std::fill(min_next_.begin(), min_next_.end(), BLOCK_INF);
+    for (uint32_t i = 0; i != bf_width_; ++i) {
+        active_.push_back(i);
+    }
 }
 
-void Aggregator::recv_packet(const Packet& packet) {
-    // Sanity check -- cannot receive block from
-    // non-existent worker
-    debug_assert(packet.worker_id_ < num_workers_);
-    recv_packets_[packet.worker_id_] = packet;
-}
-
-timedelta_t Aggregator::process_response(workernum_t worker) {
+template <typename T>
+void Aggregator<T>::recv_packet(const Packet<T>& packet) {
+    PROFILE_SCOPE("Aggregator::recv_packet");
     // Sanity check -- cannot receive block from
     // non-existent worker
+    const workernum_t worker = packet.worker_id_;
     debug_assert(worker < num_workers_);
+    if (lossy_) {
+        received_[worker] = 1;
+    }
 
-    const Packet& recv_packet = recv_packets_[worker];
-    verbose_print("[A]  Processing packet from worker " << worker
+    verbose_print("[A]  Receiving packet from worker " << worker
         << std::endl;);
 
-    for (uint32_t i = 0; i != bf_width_; ++i) {
-        const Block& recv_block = recv_packet.blocks_[i];
-        verbose_print("     Processing block ID "
+    accumulated_.clear();
+    for (uint32_t i : active_) {
+        const Block<T>& recv_block = packet.blocks_[i];
+        verbose_print("     Receiving block ID "
             << (recv_block.is_valid() ? std::to_string(recv_block.block_id_) : "INF")
             << ", next block ID "
             << (recv_block.is_next_valid() ? std::to_string(recv_block.next_) : "INF")
             << std::endl);
 
-        Block& send_block = send_packet_.blocks_[i];
+        // Remember the next block of this worker for this column
+        next_[static_cast<size_t>(i) * num_workers_ + worker] = recv_block.next_;
+
+        Block<T>& send_block = send_packet_.blocks_[i];
         // If the block is invalid, skip it
-        if (!recv_block.is_valid()) { 
+        if (!recv_block.is_valid()) {
             continue;
         }
-        // Sanity check -- the block ID must correspond to this column in the packet
-        debug_assert(recv_block.block_id_ % bf_width_ == i);
+        // Sanity check -- the block ID must correspond to this column in the
+        // packet, unless the rounds were scheduled from bitmaps
+        debug_assert(protocol_ == BITMAP || recv_block.block_id_ % bf_width_ == i);
 
-        // Aggregate the gradients from the block
-        for (size_t j = 0; j != recv_block.data_.size(); ++j) {
-            send_block.data_[j] += recv_block.data_[j];
+        // Without slots for the column, the block is dropped, and the
+        // worker's next block in the column is the dropped one again
+        if (num_slots_ != 0 && !take_slots(i)) {
+            verbose_print("     Rejected block ID " << recv_block.block_id_ << std::endl);
+            ++num_rejected_;
+            next_[static_cast<size_t>(i) * num_workers_ + worker] = recv_block.block_id_;
+            min_next_[i] = std::min(min_next_[i], recv_block.block_id_);
+            continue;
         }
+        ++num_blocks_;
+
+        // Aggregate the gradients from the block, below
+        accumulated_.push_back(i);
 
         // Initially, send_block is invalid. The first received block will set
         // the ID, and all subsequently received blocks must have the same ID
@@ -73,110 +118,408 @@ timedelta_t Aggregator::process_response(workernum_t worker) {
         min_next_[i] = std::min(min_next_[i], recv_block.next_);
     }
 
+    // The blocks of different columns are aggregated in parallel, and the
+    // packets of each column in the order in which they arrive
+    parallel_for_work(accumulated_.size(), block_size_, parallel_threshold_, [this, &packet](size_t k) {
+        const uint32_t i = accumulated_[k];
+        kernels_.accumulate_(send_packet_.blocks_[i].data_.data(), packet.blocks_[i].data_.data(), block_size_);
+    });
+}
+
+template <typename T>
+void Aggregator<T>::recv_bitmap(workernum_t worker, const Bitmap& bitmap) {
+    debug_assert(worker < num_workers_);
+    debug_assert(negotiating_);
+    if (lossy_) {
+        received_[worker] = 1;
+    }
+    verbose_print("[A]  Receiving bitmap of " << bitmap.count()
+        << " blocks from worker " << worker << std::endl;);
+    bitmaps_[worker] = bitmap;
+}
+
+template <typename T>
+timedelta_t Aggregator<T>::process_response(workernum_t worker) {
+    PROFILE_SCOPE("Aggregator::process_response");
+    // Sanity check -- cannot receive block from
+    // non-existent worker
+    debug_assert(worker < num_workers_);
+    (void) worker;
+
+    verbose_print("[A]  Processed packet from worker " << worker
+        << std::endl;);
+
     ++num_received_;
 
+    if (negotiating_) {
+        // Scheduling will require a pass over all bitmaps
+        // and over the blocks of their union
+        return static_cast<uint64_t>(ceil(0.64971 * bitmaps_[worker].num_words() * num_workers_ +
+                                          0.64971 * bitmaps_[worker].size()));
+    }
+
     // Preparing to send will require iterating over all blocks in all
     // packets that the workers send
+    const size_t num_columns = adaptive_width_ ? active_.size() : bf_width_;
     //computation_time += static_cast<uint64_t>(ceil(0.64971 * bf_width_ * num_to_receive_));
-    return static_cast<uint64_t>(ceil(0.64971 * bf_width_ * num_to_receive_));
+    return static_cast<uint64_t>(ceil(0.64971 * num_columns * num_to_receive_));
 }
 
-timedelta_t Aggregator::prepare_to_send() {
+template <typename T>
+timedelta_t Aggregator<T>::prepare_to_send() {
+    PROFILE_SCOPE("Aggregator::prepare_to_send");
     // Sanity check -- cannot prepare to send before receiving all
     // worker blocks
     debug_assert(num_received_ == num_to_receive_);
+    if (negotiating_) {
+        return prepare_schedule();
+    }
 
-    // We need to count how many workers will send packets.
-    // Workers where all next blocks in the packet are larger than min_next
-    // will send nothing. So we go and count how many workers have
-    // at least 1 valid block. But we must be careful not to double-count
-    // for the same worker, so we use a vector of chars to label whether
-    // a worker has already been counted or not.
-    num_to_receive_ = 0;
-    std::vector<char> recv;
-    recv.resize(num_workers_);
-    std::fill(recv.begin(), recv.end(), 0);
-    for (uint32_t i = 0; i != bf_width_; ++i) {
-        blocknum_t next_larger = BLOCK_INF;
-        for (uint32_t j = 0; j != num_workers_; ++j) {
-            debug_assert(recv_packets_[j].blocks_[i].next_ >= min_next_[i]);
-            // If the next block is exactly the same as min_next, this worker will be sending
-            // the packet.
-            if (recv_packets_[j].blocks_[i].next_ == min_next_[i] && min_next_[i] != BLOCK_INF) {
-                num_to_receive_ += (recv[j] == 0);
-                recv[j] = 1;
-                // Invalidate next for the next round
-                recv_packets_[j].blocks_[i].next_ = BLOCK_INF;
-            } else {
-                // Maintain the next minimum block to ask for
-                next_larger = std::min(next_larger, recv_packets_[j].blocks_[i].next_);
+    if (protocol_ == BITMAP) {
+        // The workers that send in the next round are known from the schedule
+        ++round_;
+        num_to_receive_ = (round_ < contributors_.size()) ? contributors_[round_] : 0;
+    } else {
+        // We need to count how many workers will send packets.
+        // Workers where all next blocks in the packet are larger than min_next
+        // will send nothing. So we go and count how many workers have
+        // at least 1 valid block. But we must be careful not to double-count
+        // for the same worker, so we use a vector of chars to label whether
+        // a worker has already been counted or not.
+        num_to_receive_ = 0;
+        std::vector<char> recv;
+        recv.resize(num_workers_);
+        std::fill(recv.begin(), recv.end(), 0);
+        for (uint32_t i : active_) {
+            blocknum_t next_larger = BLOCK_INF;
+            blocknum_t* next = &next_[static_cast<size_t>(i) * num_workers_];
+            for (uint32_t j = 0; j != num_workers_; ++j) {
+                debug_assert(next[j] >= min_next_[i]);
+                // If the next block is exactly the same as min_next, this worker will be sending
+                // the packet.
+                if (next[j] == min_next_[i] && min_next_[i] != BLOCK_INF) {
+                    num_to_receive_ += (recv[j] == 0);
+                    recv[j] = 1;
+                    // Invalidate next for the next round
+                    next[j] = BLOCK_INF;
+                } else {
+                    // Maintain the next minimum block to ask for
+                    next_larger = std::min(next_larger, next[j]);
+                }
+            }
+            send_packet_.blocks_[i].next_ = min_next_[i];
+            if (min_next_[i] == BLOCK_INF) {
+                dry_.push_back(i);
             }
+            min_next_[i] = next_larger;
         }
-        send_packet_.blocks_[i].next_ = min_next_[i];
-        min_next_[i] = next_larger;
     }
     send_packet_.worker_id_ = WORKER_ALL;
+    ++num_rounds_;
+    num_packets_ += num_received_;
 
     // Verbose output and debug asserts, this loop is optimized out otherwise
     verbose_print("[A]  Prepared to send packet to all workers" << std::endl);
     for (uint32_t i = 0; i != bf_width_; ++i) {
-        Block& send_block = send_packet_.blocks_[i];
+        Block<T>& send_block = send_packet_.blocks_[i];
         verbose_print("     Block ID "
             << (send_block.is_valid() ? std::to_string(send_block.block_id_) : "INF")
             << ", requesting next block ID "
             << (send_block.is_next_valid() ? std::to_string(send_block.next_) : "INF")
             << std::endl);
+        // Rejected blocks are requested again
         if (!send_block.is_valid()) {
-            debug_assert(!send_block.is_next_valid());
+            debug_assert(!send_block.is_next_valid() || slot_state_[i] == SLOT_REJECTED);
         }
     }
 
     // Count how many valid blocks will be sent
     uint32_t valid_blocks = 0;
-    for (uint32_t i = 0; i != bf_width_; ++i) {
+    for (uint32_t i : active_) {
         valid_blocks += send_packet_.blocks_[i].is_valid();
     }
     // We should have at least one valid block. If there were no
     // valid blocks, then the simulation would have ended with workers
     // preparing to send.
     debug_assert(valid_blocks > 0);
+
+    // The prepared packet is multicast while the next round is
+    // aggregated into the other slot. A worker that has not processed
+    // the previous packet yet still holds it, in which case it cannot be
+    // reused for the next round
+    if (multicast_packet_.use_count() != 1) {
+        multicast_packet_ = std::make_shared<Packet<T>>(block_size_, bf_width_);
+    } else {
+        // The workers released the packet after reading it, make sure
+        // their reads happen before it is overwritten
+        std::atomic_thread_fence(std::memory_order_acquire);
+    }
+    std::swap(send_packet_, *multicast_packet_);
+    multicast_valid_blocks_ = valid_blocks;
+    multicast_columns_ = adaptive_width_ ? active_.size() : bf_width_;
+    multicast_schedule_ = false;
+    if (lossy_) {
+        history_.push_back({multicast_packet_, valid_blocks, multicast_columns_});
+    }
+    ++seq_;
+    reset();
+
+    // The columns that were rejected take their slots before any other
+    // column can, so that they are not starved by columns that come first
+    for (uint32_t i : rejected_) {
+        if (slots_used_ + slots_per_block_ > num_slots_) {
+            break;
+        }
+        slots_used_ += slots_per_block_;
+        slot_state_[i] = SLOT_TAKEN;
+    }
+    rejected_.clear();
+
+    // Leave out the columns that ran dry from the next round on
+    retired_.swap(dry_);
+    dry_.clear();
+    if (!retired_.empty()) {
+        auto dry = std::remove_if(active_.begin(), active_.end(), [this](uint32_t i) {
+            return std::binary_search(retired_.begin(), retired_.end(), i);
+        });
+        active_.erase(dry, active_.end());
+    }
+
+    // With reduce-scatter, the payload of each block goes to its owner only,
+    // so all workers share only the header
+    if (collective_ == REDUCE_SCATTER) {
+        return LINK_LATENCY;
+    }
     // The aggregator sends only the valid blocks
     //network_time += static_cast<uint64_t>(ceil(1000 + 0.08 * block_size_ * valid_blocks));
-    return static_cast<uint64_t>(ceil(1000 + 0.8 * block_size_ * valid_blocks));
+    return static_cast<uint64_t>(ceil(LINK_LATENCY + wire_time<T>(block_size_, valid_blocks)));
+}
+
+template <typename T>
+timedelta_t Aggregator<T>::send(Worker<T>& worker) const {
+    PROFILE_SCOPE("Aggregator::send");
+    if (multicast_schedule_) {
+        return deliver(worker, {nullptr, 0, 0});
+    }
+    return deliver(worker, {multicast_packet_, multicast_valid_blocks_, multicast_columns_});
 }
 
-timedelta_t Aggregator::send(Worker& worker) {
+template <typename T>
+timedelta_t Aggregator<T>::deliver(Worker<T>& worker, const Result& result) const {
+    if (result.packet_ == nullptr) {
+        verbose_print("[A]  Sent schedule to worker " << worker.id_ << std::endl);
+        worker.recv_schedule(schedule_);
+        // Decoding the schedule
+        return static_cast<uint64_t>(ceil(0.64971 * schedule_->size()));
+    }
     verbose_print("[A]  Sent packet to worker " << worker.id_ << std::endl);
-    worker.recv_packet(send_packet_);
-    ++num_sent_;
-    uint32_t valid_blocks = 0;
-    for (uint32_t i = 0; i != bf_width_; ++i) {
-        valid_blocks += send_packet_.blocks_[i].is_valid();
+    worker.recv_packet(result.packet_);
+    if (collective_ == REDUCE_SCATTER) {
+        uint32_t owned_blocks = 0;
+        for (uint32_t i = 0; i != bf_width_; ++i) {
+            const Block<T>& block = result.packet_->blocks_[i];
+            owned_blocks += block.is_valid() && worker.owns(block.block_id_);
+        }
+        // Transferring the owned payload, then processing the packet
+        return static_cast<uint64_t>(ceil(wire_time<T>(block_size_, owned_blocks) +
+                                          0.64971 * result.columns_ +
+                                          0.64971 * owned_blocks * block_size_));
     }
+    const uint32_t valid_blocks = result.valid_blocks_;
     // Processing the packet will take iterating over each fused block,
     // and then over data for valid blocks
     //computation_time += static_cast<uint64_t>(ceil(0.64971 * bf_width_ + 0.64971 * valid_blocks * block_size_));
-    return static_cast<uint64_t>(ceil(0.64971 * bf_width_ + 0.64971 * valid_blocks * block_size_));
+    return static_cast<uint64_t>(ceil(0.64971 * result.columns_ + 0.64971 * valid_blocks * block_size_));
 }
 
-bool Aggregator::all_received() const {
-    return num_received_ == num_to_receive_;
+template <typename T>
+uint64_t Aggregator<T>::get_rounds() const {
+    return num_rounds_;
 }
 
-bool Aggregator::all_sent() const {
-    return num_sent_ == num_workers_;
+template <typename T>
+uint64_t Aggregator<T>::get_packets() const {
+    return num_packets_;
 }
 
-void Aggregator::reset() {
-    num_received_ = 0;
-    num_sent_ = 0;
-    // We must invalidate blocks in the sending slot to make sure
-    // that blocks that are skipped in prepare_to_send in the next round
-    // will not be sent again.
+template <typename T>
+uint64_t Aggregator<T>::get_blocks() const {
+    return num_blocks_;
+}
+
+template <typename T>
+uint64_t Aggregator<T>::get_rejected_blocks() const {
+    return num_rejected_;
+}
+
+template <typename T>
+void Aggregator<T>::restart() {
+    num_to_receive_ = num_workers_;
+    num_rounds_ = 0;
+    num_packets_ = 0;
+    num_blocks_ = 0;
+    num_rejected_ = 0;
+    rejected_.clear();
+    std::fill(next_.begin(), next_.end(), BLOCK_INF);
+    std::fill(min_next_.begin(), min_next_.end(), BLOCK_INF);
+    negotiating_ = (protocol_ == BITMAP);
+    schedule_.reset();
+    contributors_.clear();
+    round_ = 0;
+    multicast_schedule_ = false;
+    seq_ = 0;
+    history_.clear();
+    active_.clear();
     for (uint32_t i = 0; i != bf_width_; ++i) {
-        send_packet_.blocks_[i].invalidate();
-        std::fill(send_packet_.blocks_[i].data_.begin(),
-                  send_packet_.blocks_[i].data_.end(),
-                  0.0);
+        active_.push_back(i);
+    }
+    dry_.clear();
+    retired_.clear();
+    reset();
+}
+
+template <typename T>
+void Aggregator<T>::set_parallel_threshold(size_t threshold) {
+    parallel_threshold_ = threshold;
+}
+
+template <typename T>
+void Aggregator<T>::set_adaptive_width(bool adaptive) {
+    adaptive_width_ = adaptive;
+}
+
+template <typename T>
+void Aggregator<T>::set_slot_pool(uint32_t num_slots, uint32_t slot_size) {
+    if (num_slots == 0) {
+        num_slots_ = 0;
+        return;
+    }
+    if (protocol_ == BITMAP) {
+        throw std::invalid_argument("Slot pool needs the chaining protocol");
+    }
+    if (slot_size == 0 || static_cast<uint64_t>(num_slots) * slot_size < block_size_) {
+        throw std::invalid_argument("Slot pool must hold at least one block");
+    }
+    num_slots_ = num_slots;
+    slot_size_ = slot_size;
+    slots_per_block_ = (block_size_ + slot_size_ - 1) / slot_size_;
+}
+
+template <typename T>
+bool Aggregator<T>::take_slots(uint32_t column) {
+    if (slot_state_[column] == SLOT_NONE) {
+        if (slots_used_ + slots_per_block_ <= num_slots_) {
+            slots_used_ += slots_per_block_;
+            slot_state_[column] = SLOT_TAKEN;
+        } else {
+            slot_state_[column] = SLOT_REJECTED;
+            rejected_.push_back(column);
+        }
+    }
+    return slot_state_[column] == SLOT_TAKEN;
+}
+
+template <typename T>
+void Aggregator<T>::set_lossy(bool lossy) {
+    lossy_ = lossy;
+    received_.assign(lossy ? num_workers_ : 0, 0);
+    history_.clear();
+}
+
+template <typename T>
+uint64_t Aggregator<T>::get_seq() const {
+    return seq_;
+}
+
+template <typename T>
+bool Aggregator<T>::accepts(workernum_t worker) const {
+    return !received_[worker];
+}
+
+template <typename T>
+timedelta_t Aggregator<T>::resend_time(uint64_t seq) const {
+    const Result& result = history_.at(seq);
+    if (result.packet_ == nullptr) {
+        return static_cast<uint64_t>(ceil(LINK_LATENCY + wire_time_bytes(schedule_bytes_)));
     }
+    if (collective_ == REDUCE_SCATTER) {
+        return LINK_LATENCY;
+    }
+    return static_cast<uint64_t>(ceil(LINK_LATENCY + wire_time<T>(block_size_, result.valid_blocks_)));
+}
+
+template <typename T>
+timedelta_t Aggregator<T>::resend(Worker<T>& worker, uint64_t seq) const {
+    return deliver(worker, history_.at(seq));
 }
+
+template <typename T>
+timedelta_t Aggregator<T>::prepare_schedule() {
+    Bitmap all(bitmaps_[0].size());
+    for (const Bitmap& bitmap : bitmaps_) {
+        all |= bitmap;
+    }
+    std::shared_ptr<std::vector<blocknum_t>> schedule =
+        std::make_shared<std::vector<blocknum_t>>(all.blocks());
+
+    // A worker sends in a round iff it has any of the round's blocks
+    const size_t num_rounds = (schedule->size() + bf_width_ - 1) / bf_width_;
+    contributors_.assign(num_rounds, 0);
+    for (const Bitmap& bitmap : bitmaps_) {
+        for (size_t k = 0; k < schedule->size(); ++k) {
+            if (bitmap.test((*schedule)[k])) {
+                ++contributors_[k / bf_width_];
+                // Skip to the next round
+                k = (k / bf_width_ + 1) * bf_width_ - 1;
+            }
+        }
+    }
+    verbose_print("[A]  Scheduled " << schedule->size() << " blocks in "
+        << num_rounds << " rounds" << std::endl);
+
+    schedule_ = schedule;
+    negotiating_ = false;
+    multicast_schedule_ = true;
+    round_ = 0;
+    num_to_receive_ = contributors_.empty() ? 0 : contributors_[0];
+    num_received_ = 0;
+    std::fill(received_.begin(), received_.end(), 0);
+    if (lossy_) {
+        history_.push_back({nullptr, 0, 0});
+    }
+    ++seq_;
+    // The union is multicast, from which workers rebuild the schedule
+    schedule_bytes_ = all.compressed_bytes();
+    return static_cast<uint64_t>(ceil(LINK_LATENCY + wire_time_bytes(schedule_bytes_)));
+}
+
+template <typename T>
+bool Aggregator<T>::all_received() const {
+    return num_received_ == num_to_receive_;
+}
+
+template <typename T>
+void Aggregator<T>::reset() {
+    num_received_ = 0;
+    std::fill(received_.begin(), received_.end(), 0);
+    // All slots are freed once the result is multicast
+    slots_used_ = 0;
+    std::fill(slot_state_.begin(), slot_state_.end(), SLOT_NONE);
+    // We must invalidate blocks in the aggregation slot to make sure
+    // that blocks that are skipped in prepare_to_send in the next round
+    // will not be sent again. Columns that are no longer active
+    // stay invalid, except those that ran dry in the previous round
+    const size_t num_active = active_.size();
+    parallel_for_work(num_active + retired_.size(), block_size_, parallel_threshold_,
+                      [this, num_active](size_t k) {
+        Block<T>& block = send_packet_.blocks_[k < num_active ? active_[k] : retired_[k - num_active]];
+        block.invalidate();
+        block.next_ = BLOCK_INF;
+        std::fill(block.data_.begin(), block.data_.end(), T(0));
+    });
+}
+
+template class Aggregator<float>;
+template class Aggregator<double>;
+template class Aggregator<bf16>;
+template class Aggregator<int32_t>;
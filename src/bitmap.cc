@@ -0,0 +1,61 @@
+#include <stdexcept>
+#include <algorithm>
+
+#include "bitmap.h"
+
+Bitmap::Bitmap(size_t size) {
+    assign(size);
+}
+
+void Bitmap::assign(size_t size) {
+    size_ = size;
+    words_.assign((size + 63) / 64, 0);
+}
+
+void Bitmap::set(size_t i) {
+    words_[i / 64] |= 1ULL << (i % 64);
+}
+
+bool Bitmap::test(size_t i) const {
+    return (words_[i / 64] >> (i % 64)) & 1;
+}
+
+Bitmap& Bitmap::operator|=(const Bitmap& other) {
+    if (other.size_ != size_) {
+        throw std::invalid_argument("Bitmaps must have the same size");
+    }
+    for (size_t w = 0; w != words_.size(); ++w) {
+        words_[w] |= other.words_[w];
+    }
+    return *this;
+}
+
+size_t Bitmap::size() const {
+    return size_;
+}
+
+size_t Bitmap::count() const {
+    size_t count = 0;
+    for (uint64_t word : words_) {
+        count += __builtin_popcountll(word);
+    }
+    return count;
+}
+
+size_t Bitmap::num_words() const {
+    return words_.size();
+}
+
+size_t Bitmap::compressed_bytes() const {
+    return std::min(words_.size() * sizeof(uint64_t), count() * sizeof(uint32_t));
+}
+
+std::vector<uint64_t> Bitmap::blocks() const {
+    std::vector<uint64_t> blocks;
+    for (size_t w = 0; w != words_.size(); ++w) {
+        for (uint64_t word = words_[w]; word != 0; word &= word - 1) {
+            blocks.push_back(w * 64 + __builtin_ctzll(word));
+        }
+    }
+    return blocks;
+}
@@ -1,25 +1,40 @@
 #include "block.h"
 
-Block::Block(uint32_t block_size) :
+template <typename T>
+Block<T>::Block(uint32_t block_size) :
     next_(BLOCK_INF),
     block_id_(BLOCK_INF) {
     data_.resize(block_size);
 }
 
-bool Block::is_valid() const {
+template <typename T>
+bool Block<T>::is_valid() const {
     return block_id_ != BLOCK_INF;
 }
 
-bool Block::is_next_valid() const {
+template <typename T>
+bool Block<T>::is_next_valid() const {
     return next_ != BLOCK_INF;
 }
 
-void Block::invalidate() {
+template <typename T>
+void Block<T>::invalidate() {
     block_id_ = BLOCK_INF;
 }
 
-Packet::Packet(uint32_t block_size, uint32_t bf_width) {
+template <typename T>
+Packet<T>::Packet(uint32_t block_size, uint32_t bf_width) {
     for (uint32_t i = 0; i != bf_width; ++i) {
-        blocks_.push_back(Block(block_size));
+        blocks_.push_back(Block<T>(block_size));
     }
 }
+
+template struct Block<float>;
+template struct Block<double>;
+template struct Block<bf16>;
+template struct Block<int32_t>;
+
+template struct Packet<float>;
+template struct Packet<double>;
+template struct Packet<bf16>;
+template struct Packet<int32_t>;
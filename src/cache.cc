@@ -0,0 +1,114 @@
+#include <stdexcept>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <cstring>
+
+#include "cache.h"
+#include "simulator.h"
+#include "memory.h"
+
+// Set by the makefile from the commit and the uncommitted changes,
+// empty if the version is unknown
+#ifndef CODE_VERSION
+#define CODE_VERSION ""
+#endif
+
+static constexpr uint64_t fnv_offset = 14695981039346656037ULL;
+static constexpr uint64_t fnv_prime = 1099511628211ULL;
+
+static void fnv_add(uint64_t& hash, const void* data, size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i != size; ++i) {
+        hash ^= bytes[i];
+        hash *= fnv_prime;
+    }
+}
+
+ResultCache::ResultCache(const std::string& path) :
+    path_(versioned() ? path : ""),
+    hits_(0),
+    misses_(0) {
+    if (path_.empty()) {
+        if (!path.empty()) {
+            std::cerr << "Warning: the version of the code is unknown, "
+                         "so sweep results are not cached" << std::endl;
+        }
+        return;
+    }
+    std::ifstream in(path_);
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        uint64_t k;
+        SweepResult result;
+        char comma1, comma2;
+        fields >> std::hex >> k >> std::dec >> comma1 >> result.time_ >> comma2 >> result.rounds_;
+        // A line cut short by an interrupted sweep is simply skipped
+        if (!fields || comma1 != ',' || comma2 != ',') {
+            continue;
+        }
+        results_[k] = result;
+    }
+}
+
+bool ResultCache::versioned() {
+    return std::strlen(CODE_VERSION) != 0;
+}
+
+std::string ResultCache::default_path() {
+    const char* path = std::getenv("RESULT_CACHE");
+    return (path != nullptr) ? path : "results.cache";
+}
+
+SweepResult ResultCache::run(const SweepPoint& point) {
+    const uint64_t k = key(point);
+    auto it = results_.find(k);
+    if (it != results_.end()) {
+        ++hits_;
+        return it->second;
+    }
+    ++misses_;
+
+    // On hosts with several NUMA nodes, points take turns on the nodes, and
+    // each simulation keeps its threads and its memory on one node
+    const int num_nodes = num_memory_nodes();
+    NodeBinding binding(num_nodes > 1 ? static_cast<int>((misses_ - 1) % num_nodes) : -1);
+    Simulator s(point.num_workers_, point.block_size_, point.bf_width_);
+    s.seed(point.seed_);
+    s.generate_data(point.data_size_, point.block_size_, point.sparsity_);
+    s.run();
+    const SweepResult result = {s.get_time(), s.get_rounds()};
+    results_[k] = result;
+
+    if (!path_.empty()) {
+        std::ofstream out(path_, std::ios::app);
+        out << std::hex << k << std::dec << "," << result.time_ << "," << result.rounds_ << std::endl;
+        if (!out) {
+            throw std::runtime_error("Cannot write to result cache " + path_);
+        }
+    }
+    return result;
+}
+
+uint64_t ResultCache::get_hits() const {
+    return hits_;
+}
+
+uint64_t ResultCache::get_misses() const {
+    return misses_;
+}
+
+uint64_t ResultCache::key(const SweepPoint& point) {
+    uint64_t hash = fnv_offset;
+    fnv_add(hash, &point.num_workers_, sizeof(point.num_workers_));
+    fnv_add(hash, &point.block_size_, sizeof(point.block_size_));
+    fnv_add(hash, &point.bf_width_, sizeof(point.bf_width_));
+    const uint64_t data_size = point.data_size_;
+    fnv_add(hash, &data_size, sizeof(data_size));
+    fnv_add(hash, &point.sparsity_, sizeof(point.sparsity_));
+    fnv_add(hash, &point.seed_, sizeof(point.seed_));
+    fnv_add(hash, &COST_MODEL_VERSION, sizeof(COST_MODEL_VERSION));
+    fnv_add(hash, CODE_VERSION, std::strlen(CODE_VERSION));
+    return hash;
+}
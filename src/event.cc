@@ -6,17 +6,31 @@
 Event::Event(EventType type,
              workernum_t worker_id,
              timestamp_t start_timestamp,
-             timestamp_t end_timestamp) :
+             timestamp_t end_timestamp,
+             uint64_t seq) :
     type_(type),
     worker_id_(worker_id),
     start_timestamp_(start_timestamp),
-    end_timestamp_(end_timestamp) {
+    end_timestamp_(end_timestamp),
+    seq_(seq) {
 }
 
+// Events that end at the same time are ordered by worker, type and round,
+// so that the order of processing does not depend on the order of insertion.
+// This keeps the results of the sequential and the parallel simulator identical
 bool Event::operator<(const Event &rhs) const {
-    return end_timestamp_ < rhs.end_timestamp_;
+    if (end_timestamp_ != rhs.end_timestamp_) {
+        return end_timestamp_ < rhs.end_timestamp_;
+    }
+    if (worker_id_ != rhs.worker_id_) {
+        return worker_id_ < rhs.worker_id_;
+    }
+    if (type_ != rhs.type_) {
+        return type_ < rhs.type_;
+    }
+    return seq_ < rhs.seq_;
 }
 
 bool Event::operator>(const Event& rhs) const {
-    return end_timestamp_ > rhs.end_timestamp_;
+    return rhs < *this;
 }
@@ -0,0 +1,90 @@
+#include <cstring>
+
+#include "kernels.h"
+
+// Elements checked at once by is_zero before deciding whether to stop.
+// Nonzero blocks usually stop after the first group, and zero blocks
+// are checked a whole group at a time. Counting the nonzero elements of a
+// group, rather than or-ing flags, lets the group be vectorized
+static constexpr uint32_t zero_check_group = 64;
+
+template <typename T>
+static void copy(T* __restrict dst, const T* __restrict src, uint32_t block_size) {
+    std::memcpy(dst, src, block_size * sizeof(T));
+}
+
+// N == 0 means that the block size is only known at run time
+template <typename T, uint32_t N>
+static void accumulate_block(T* __restrict dst, const T* __restrict src, uint32_t block_size) {
+    const uint32_t n = (N == 0) ? block_size : N;
+    accumulate(dst, src, n);
+}
+
+template <typename T, uint32_t N>
+static bool is_zero(const T* src, uint32_t block_size) {
+    const uint32_t n = (N == 0) ? block_size : N;
+    constexpr uint32_t group = (N != 0 && N < zero_check_group) ? N : zero_check_group;
+    uint32_t i = 0;
+    for (; i + group <= n; i += group) {
+        uint32_t nonzero = 0;
+        for (uint32_t j = 0; j != group; ++j) {
+            nonzero += (src[i + j] != T(0));
+        }
+        if (nonzero != 0) {
+            return false;
+        }
+    }
+    for (; i != n; ++i) {
+        if (src[i] != T(0)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename T, uint32_t N>
+static constexpr BlockKernels<T> kernels() {
+    // The library's memcpy is already fast for any size, and expanding it
+    // inline for a constant size is slower for mid-sized blocks, so copies
+    // always use the generic kernel
+    return {copy<T>, accumulate_block<T, N>, is_zero<T, N>};
+}
+
+template <typename T>
+BlockKernels<T> BlockKernels<T>::select(uint32_t block_size) {
+    // Indexed by log2(block_size / MIN_SPECIALIZED_BLOCK_SIZE)
+    static constexpr BlockKernels<T> table[] = {
+        kernels<T, 8>(),
+        kernels<T, 16>(),
+        kernels<T, 32>(),
+        kernels<T, 64>(),
+        kernels<T, 128>(),
+        kernels<T, 256>(),
+        kernels<T, 512>(),
+        kernels<T, 1024>(),
+        kernels<T, 2048>(),
+        kernels<T, 4096>(),
+        kernels<T, 8192>(),
+        kernels<T, 16384>(),
+    };
+    static_assert(sizeof(table) / sizeof(table[0]) ==
+                  __builtin_ctz(MAX_SPECIALIZED_BLOCK_SIZE / MIN_SPECIALIZED_BLOCK_SIZE) + 1);
+
+    const bool power_of_two = (block_size & (block_size - 1)) == 0;
+    if (!power_of_two ||
+        block_size < MIN_SPECIALIZED_BLOCK_SIZE ||
+        block_size > MAX_SPECIALIZED_BLOCK_SIZE) {
+        return generic();
+    }
+    return table[__builtin_ctz(block_size / MIN_SPECIALIZED_BLOCK_SIZE)];
+}
+
+template <typename T>
+BlockKernels<T> BlockKernels<T>::generic() {
+    return kernels<T, 0>();
+}
+
+template struct BlockKernels<float>;
+template struct BlockKernels<double>;
+template struct BlockKernels<bf16>;
+template struct BlockKernels<int32_t>;
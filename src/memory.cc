@@ -0,0 +1,155 @@
+#include <fstream>
+#include <string>
+#include <algorithm>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "memory.h"
+#include "utils.h"
+
+// Memory policy mode of mbind, from <numaif.h>, which is not
+// used because it needs libnuma
+static constexpr int mpol_bind = 2;
+
+// Pages touched by one task of the first-touch loop
+static constexpr size_t touch_chunk = 16 * HUGE_PAGE_SIZE;
+
+MemoryPolicy& memory_policy() {
+    static thread_local MemoryPolicy policy;
+    return policy;
+}
+
+int num_memory_nodes() {
+    // The nodes are listed like "0-1"
+    std::ifstream file("/sys/devices/system/node/possible");
+    std::string nodes;
+    if (!(file >> nodes)) {
+        return 1;
+    }
+    const size_t dash = nodes.find_last_of("-,");
+    return std::stoi(dash == std::string::npos ? nodes : nodes.substr(dash + 1)) + 1;
+}
+
+// Round a size up to whole huge pages
+static size_t huge_page_round(size_t bytes) {
+    return (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+}
+
+// Map anonymous memory, with the explicit huge pages if requested and available
+static void* map(size_t bytes, HugePages huge_pages) {
+    void* buffer = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if (huge_pages == HUGE_PAGES_EXPLICIT) {
+        buffer = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (buffer != MAP_FAILED) {
+            return buffer;
+        }
+    }
+#endif
+    buffer = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffer == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+#ifdef MADV_HUGEPAGE
+    if (huge_pages != HUGE_PAGES_NONE) {
+        // Only a hint, the buffer works without huge pages
+        madvise(buffer, bytes, MADV_HUGEPAGE);
+    }
+#endif
+    return buffer;
+}
+
+void* allocate_buffer(size_t bytes) {
+    if (bytes < HUGE_PAGE_SIZE) {
+        return ::operator new(bytes);
+    }
+    const MemoryPolicy& policy = memory_policy();
+    bytes = huge_page_round(bytes);
+    char* buffer = static_cast<char*>(map(bytes, policy.huge_pages_));
+
+#ifdef SYS_mbind
+    if (policy.node_ >= 0) {
+        // Only a hint as well, the kernel may not support NUMA
+        const size_t bits = 8 * sizeof(unsigned long);
+        std::vector<unsigned long> mask(policy.node_ / bits + 1, 0);
+        mask[policy.node_ / bits] = 1UL << (policy.node_ % bits);
+        syscall(SYS_mbind, buffer, bytes, mpol_bind, mask.data(), mask.size() * bits + 1, 0);
+    }
+#endif
+
+    // Fault the pages in from several threads at once. Pages are placed
+    // when they are first touched, so without a bound node they end up
+    // spread over the nodes of the threads
+    const size_t num_chunks = (bytes + touch_chunk - 1) / touch_chunk;
+    const size_t page_size = sysconf(_SC_PAGESIZE);
+    ThreadPool::instance().parallel_for(num_chunks, [buffer, bytes, page_size](size_t chunk) {
+        const size_t end = std::min(bytes, (chunk + 1) * touch_chunk);
+        for (size_t i = chunk * touch_chunk; i < end; i += page_size) {
+            buffer[i] = 0;
+        }
+    });
+    return buffer;
+}
+
+void free_buffer(void* buffer, size_t bytes) {
+    if (bytes < HUGE_PAGE_SIZE) {
+        ::operator delete(buffer);
+        return;
+    }
+    munmap(buffer, huge_page_round(bytes));
+}
+
+NodeBinding::NodeBinding(int node) :
+    node_(node),
+    cpus_saved_(false),
+    saved_node_(memory_policy().node_),
+    saved_pool_(nullptr) {
+    if (node_ < 0) {
+        return;
+    }
+    memory_policy().node_ = node_;
+
+    // The CPUs are listed like "0-3,8-11"
+    std::ifstream file("/sys/devices/system/node/node" + std::to_string(node_) + "/cpulist");
+    std::string list;
+    if (!(file >> list)) {
+        return;
+    }
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    size_t pos = 0;
+    while (pos < list.size()) {
+        size_t end = list.find(',', pos);
+        if (end == std::string::npos) {
+            end = list.size();
+        }
+        const std::string range = list.substr(pos, end - pos);
+        const size_t dash = range.find('-');
+        const int first = std::stoi(range.substr(0, dash));
+        const int last = (dash == std::string::npos) ? first : std::stoi(range.substr(dash + 1));
+        for (int cpu = first; cpu <= last; ++cpu) {
+            CPU_SET(cpu, &cpus);
+        }
+        pos = end + 1;
+    }
+    if (sched_getaffinity(0, sizeof(saved_cpus_), &saved_cpus_) == 0 &&
+        sched_setaffinity(0, sizeof(cpus), &cpus) == 0) {
+        cpus_saved_ = true;
+        // Threads inherit the CPUs of the thread that starts them
+        pool_ = std::make_unique<ThreadPool>(std::max(1, CPU_COUNT(&cpus)));
+        saved_pool_ = ThreadPool::set_instance(pool_.get());
+    }
+}
+
+NodeBinding::~NodeBinding() {
+    memory_policy().node_ = saved_node_;
+    if (pool_) {
+        ThreadPool::set_instance(saved_pool_);
+    }
+    if (cpus_saved_) {
+        sched_setaffinity(0, sizeof(saved_cpus_), &saved_cpus_);
+    }
+}
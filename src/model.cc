@@ -0,0 +1,156 @@
+#include <stdexcept>
+#include <sstream>
+#include <algorithm>
+
+#include "model.h"
+#include "simulator.h"
+
+Tensor::Tensor(const std::string& name, size_t size, timedelta_t backward_time) :
+    name_(name),
+    size_(size),
+    backward_time_(backward_time) {
+}
+
+Model Model::parse(std::istream& in) {
+    Model model;
+    std::string line;
+    size_t line_num = 0;
+    while (std::getline(in, line)) {
+        ++line_num;
+        std::istringstream fields(line);
+        std::string name;
+        if (!(fields >> name) || name[0] == '#') {
+            continue;
+        }
+        size_t size;
+        timedelta_t backward_time;
+        std::string extra;
+        if (!(fields >> size >> backward_time) || (fields >> extra)) {
+            throw std::invalid_argument("Malformed tensor description on line " +
+                                        std::to_string(line_num));
+        }
+        model.add_tensor(name, size, backward_time);
+    }
+    return model;
+}
+
+void Model::add_tensor(const std::string& name, size_t size, timedelta_t backward_time) {
+    if (size == 0) {
+        throw std::invalid_argument("Tensor must have at least one element");
+    }
+    tensors_.push_back(Tensor(name, size, backward_time));
+}
+
+std::vector<Bucket> Model::make_buckets(size_t bucket_size) const {
+    if (bucket_size == 0) {
+        throw std::invalid_argument("Bucket size must be positive");
+    }
+    std::vector<Bucket> buckets;
+    timestamp_t time = 0;
+    bool open = false;
+    // The backward pass starts from the last tensor
+    for (size_t i = tensors_.size(); i-- != 0;) {
+        if (!open) {
+            buckets.push_back(Bucket{{}, 0, 0});
+            open = true;
+        }
+        Bucket& bucket = buckets.back();
+        time += tensors_[i].backward_time_;
+        bucket.tensors_.push_back(i);
+        bucket.size_ += tensors_[i].size_;
+        bucket.ready_time_ = time;
+        if (bucket.size_ >= bucket_size) {
+            open = false;
+        }
+    }
+    return buckets;
+}
+
+timedelta_t Model::backward_time() const {
+    timedelta_t time = 0;
+    for (const Tensor& t : tensors_) {
+        time += t.backward_time_;
+    }
+    return time;
+}
+
+size_t Model::size() const {
+    size_t size = 0;
+    for (const Tensor& t : tensors_) {
+        size += t.size_;
+    }
+    return size;
+}
+
+const std::vector<Tensor>& Model::tensors() const {
+    return tensors_;
+}
+
+BucketedSimulator::BucketedSimulator(const Model& model,
+                                     size_t bucket_size,
+                                     workernum_t num_workers,
+                                     uint32_t block_size,
+                                     uint32_t bf_width) :
+    num_workers_(num_workers),
+    block_size_(block_size),
+    bf_width_(bf_width),
+    sparsity_(0.0),
+    seed_(0),
+    compute_time_(model.backward_time()),
+    buckets_(model.make_buckets(bucket_size)),
+    time_(0),
+    communication_time_(0) {
+}
+
+void BucketedSimulator::set_sparsity(float sparsity) {
+    if (sparsity < 0.0 || sparsity > 1.0) {
+        throw std::invalid_argument("Sparsity must be between 0 and 1");
+    }
+    sparsity_ = sparsity;
+}
+
+void BucketedSimulator::seed(uint32_t seed) {
+    seed_ = seed;
+}
+
+void BucketedSimulator::run() {
+    // Time when the aggregator becomes free to start the next allreduce
+    uint64_t free_time = 0;
+    communication_time_ = 0;
+    for (size_t b = 0; b != buckets_.size(); ++b) {
+        const Bucket& bucket = buckets_[b];
+        // Buckets are padded to whole blocks. The padding shares its block
+        // with the last elements of the bucket, so it adds no traffic
+        const size_t size = (bucket.size_ + block_size_ - 1) / block_size_ * block_size_;
+
+        Simulator s(num_workers_, block_size_, bf_width_);
+        s.seed(seed_ + b);
+        s.generate_data(size, block_size_, sparsity_);
+        s.run();
+
+        uint64_t start = std::max(free_time, bucket.ready_time_);
+        free_time = start + s.get_time();
+        communication_time_ += s.get_time();
+    }
+    time_ = std::max(free_time, static_cast<uint64_t>(compute_time_));
+}
+
+uint64_t BucketedSimulator::get_time() const {
+    return time_;
+}
+
+uint64_t BucketedSimulator::get_compute_time() const {
+    return compute_time_;
+}
+
+uint64_t BucketedSimulator::get_communication_time() const {
+    return communication_time_;
+}
+
+uint64_t BucketedSimulator::get_exposed_time() const {
+    return time_ - compute_time_;
+}
+
+const std::vector<Bucket>& BucketedSimulator::buckets() const {
+    return buckets_;
+}
@@ -0,0 +1,266 @@
+#include <stdexcept>
+#include <cassert>
+#include <iostream>
+#include <algorithm>
+
+#include "multijob.h"
+#include "utils.h"
+
+void FifoPolicy::push(const Task& task) {
+    tasks_.push_back(task);
+}
+
+Task FifoPolicy::pop() {
+    Task task = tasks_.front();
+    tasks_.pop_front();
+    return task;
+}
+
+bool FifoPolicy::empty() const {
+    return tasks_.empty();
+}
+
+RoundRobinPolicy::RoundRobinPolicy() :
+    last_(0),
+    size_(0) {
+}
+
+void RoundRobinPolicy::push(const Task& task) {
+    if (task.job_ >= tasks_.size()) {
+        tasks_.resize(task.job_ + 1);
+    }
+    tasks_[task.job_].push_back(task);
+    ++size_;
+}
+
+Task RoundRobinPolicy::pop() {
+    debug_assert(size_ > 0);
+    // Find the next job after the last served one that has a ready task
+    jobnum_t job = last_;
+    do {
+        job = (job + 1) % tasks_.size();
+    } while (tasks_[job].empty());
+    Task task = tasks_[job].front();
+    tasks_[job].pop_front();
+    last_ = job;
+    --size_;
+    return task;
+}
+
+bool RoundRobinPolicy::empty() const {
+    return size_ == 0;
+}
+
+WeightedFairPolicy::WeightedFairPolicy(const std::vector<double>& weights) :
+    weights_(weights),
+    tasks_(weights.size()),
+    finish_(weights.size(), 0.0),
+    virtual_time_(0.0),
+    size_(0) {
+    for (double w : weights_) {
+        if (w <= 0.0) {
+            throw std::invalid_argument("Job weights must be positive");
+        }
+    }
+}
+
+void WeightedFairPolicy::push(const Task& task) {
+    if (task.job_ >= weights_.size()) {
+        throw std::invalid_argument("No weight given for job " + std::to_string(task.job_));
+    }
+    const double start = std::max(virtual_time_, finish_[task.job_]);
+    finish_[task.job_] = start + task.demand_ / weights_[task.job_];
+    tasks_[task.job_].push_back({start, task});
+    ++size_;
+}
+
+Task WeightedFairPolicy::pop() {
+    debug_assert(size_ > 0);
+    // Tags of a job increase, so the lowest tag is at the front of some job
+    jobnum_t best = 0;
+    bool found = false;
+    for (jobnum_t j = 0; j != tasks_.size(); ++j) {
+        if (!tasks_[j].empty() && (!found || tasks_[j].front().first < tasks_[best].front().first)) {
+            best = j;
+            found = true;
+        }
+    }
+    virtual_time_ = tasks_[best].front().first;
+    Task task = tasks_[best].front().second;
+    tasks_[best].pop_front();
+    --size_;
+    return task;
+}
+
+bool WeightedFairPolicy::empty() const {
+    return size_ == 0;
+}
+
+MultiJobSimulator::MultiJobSimulator(SchedulingPolicy& compute_policy,
+                                     SchedulingPolicy& link_policy,
+                                     uint32_t compute_servers) :
+    compute_policy_(compute_policy),
+    link_policy_(link_policy),
+    compute_servers_(compute_servers) {
+    if (compute_servers_ == 0) {
+        throw std::invalid_argument("Aggregator must have at least one compute server");
+    }
+}
+
+jobnum_t MultiJobSimulator::add_job(const Simulator<>& job, timestamp_t start_time) {
+    if (job.gradients(0).empty()) {
+        throw std::invalid_argument("Job must have its data generated");
+    }
+    jobs_.push_back(job);
+    start_times_.push_back(start_time);
+    return jobs_.size() - 1;
+}
+
+void MultiJobSimulator::run() {
+    // Each job alone, on a copy of its data
+    solo_times_.clear();
+    for (jobnum_t j = 0; j != jobs_.size(); ++j) {
+        std::vector<Simulator<>> solo = {jobs_[j]};
+        FifoPolicy compute;
+        FifoPolicy link;
+        solo_times_.push_back(simulate(solo, {start_times_[j]}, compute, link)[0]);
+    }
+    // All jobs together, also on copies, so that jobs_ can be run again
+    runs_.clear();
+    for (const Simulator<>& job : jobs_) {
+        runs_.push_back(job);
+    }
+    completion_times_ = simulate(runs_, start_times_, compute_policy_, link_policy_);
+}
+
+bool MultiJobSimulator::verify() const {
+    for (const Simulator<>& job : runs_) {
+        if (!job.verify()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint64_t MultiJobSimulator::get_time() const {
+    uint64_t time = 0;
+    for (jobnum_t j = 0; j != completion_times_.size(); ++j) {
+        time = std::max(time, start_times_[j] + completion_times_[j]);
+    }
+    return time;
+}
+
+uint64_t MultiJobSimulator::get_completion_time(jobnum_t job) const {
+    return completion_times_.at(job);
+}
+
+uint64_t MultiJobSimulator::get_solo_time(jobnum_t job) const {
+    return solo_times_.at(job);
+}
+
+double MultiJobSimulator::get_slowdown(jobnum_t job) const {
+    return static_cast<double>(get_completion_time(job)) / get_solo_time(job);
+}
+
+std::vector<uint64_t> MultiJobSimulator::simulate(std::vector<Simulator<>>& jobs,
+                                                  const std::vector<timestamp_t>& start_times,
+                                                  SchedulingPolicy& compute_policy,
+                                                  SchedulingPolicy& link_policy) const {
+    Resource compute = {&compute_policy, compute_servers_, 0};
+    Resource link = {&link_policy, 1, 0};
+    EventQueue events;
+
+    // Each job handles its events in a logical process of its own, like
+    // Simulator::run does. Its queue only collects the events scheduled
+    // by the event being handled, which are then passed on to events
+    std::vector<std::vector<Simulator<>::LogicalProcess>> lps(jobs.size());
+    for (jobnum_t j = 0; j != jobs.size(); ++j) {
+        Simulator<>& job = jobs[j];
+        job.start();
+        job.num_partitions_ = 0;
+        // The job starts at its start time instead
+        job.events_ = Simulator<>::EventQueue();
+        lps[j].resize(1);
+        lps[j][0].time_ = start_times[j];
+        events.push({Event(INIT_EVENT, 0, start_times[j], start_times[j]), j});
+    }
+
+    while (!events.empty()) {
+        const Event e = events.top().first;
+        const jobnum_t j = events.top().second;
+        events.pop();
+        const timestamp_t time = e.end_timestamp_;
+        verbose_print("[JOB " << j << "]" << std::endl);
+
+        // The event ends the task that held a resource
+        switch (e.type_) {
+            case AGGREGATOR_PROCESS:
+            case AGGREGATOR_PREPARE:
+                release(compute, time, events);
+                break;
+            case AGGREGATOR_SEND:
+            case AGGREGATOR_RESEND:
+                release(link, time, events);
+                break;
+            default:
+                break;
+        }
+
+        jobs[j].handle(e, lps[j], 0);
+
+        // Processing packets and preparing the result need the aggregator's
+        // compute, and sending the result needs its link. Workers are not
+        // shared, so their events happen when they are due
+        Simulator<>::EventQueue& scheduled = lps[j][0].events_;
+        while (!scheduled.empty()) {
+            const Event next = scheduled.top();
+            scheduled.pop();
+            const Task task = {j, next, next.end_timestamp_ - next.start_timestamp_};
+            switch (next.type_) {
+                case AGGREGATOR_PROCESS:
+                case AGGREGATOR_PREPARE:
+                    submit(compute, task, time, events);
+                    break;
+                case AGGREGATOR_SEND:
+                case AGGREGATOR_RESEND:
+                    submit(link, task, time, events);
+                    break;
+                default:
+                    events.push({next, j});
+                    break;
+            }
+        }
+    }
+
+    std::vector<uint64_t> finish(jobs.size());
+    for (jobnum_t j = 0; j != jobs.size(); ++j) {
+        jobs[j].finish(lps[j]);
+        finish[j] = lps[j][0].time_ - start_times[j];
+    }
+    return finish;
+}
+
+void MultiJobSimulator::submit(Resource& resource,
+                               const Task& task,
+                               timestamp_t time,
+                               EventQueue& events) const {
+    resource.policy_->push(task);
+    dispatch(resource, time, events);
+}
+
+void MultiJobSimulator::release(Resource& resource, timestamp_t time, EventQueue& events) const {
+    debug_assert(resource.busy_ > 0);
+    --resource.busy_;
+    dispatch(resource, time, events);
+}
+
+void MultiJobSimulator::dispatch(Resource& resource, timestamp_t time, EventQueue& events) const {
+    while (resource.busy_ < resource.servers_ && !resource.policy_->empty()) {
+        Task task = resource.policy_->pop();
+        ++resource.busy_;
+        // The task starts now, and its event happens when it is done
+        task.event_.start_timestamp_ = time;
+        task.event_.end_timestamp_ = time + task.demand_;
+        events.push({task.event_, task.job_});
+    }
+}
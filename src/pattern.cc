@@ -0,0 +1,146 @@
+#include <stdexcept>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+
+#include "pattern.h"
+
+static void check_sparsity(float sparsity) {
+    if (sparsity < 0.0 || sparsity > 1.0) {
+        throw std::invalid_argument("Sparsity must be between 0 and 1");
+    }
+}
+
+void SparsityPattern::prepare(size_t num_blocks) {
+    (void) num_blocks;
+}
+
+UniformPattern::UniformPattern(float sparsity) :
+    sparsity_(sparsity) {
+    check_sparsity(sparsity_);
+}
+
+void UniformPattern::generate(std::vector<char>& mask, std::mt19937& generator) {
+    std::uniform_real_distribution<> distr(0.0, 1.0);
+    for (size_t i = 0; i != mask.size(); ++i) {
+        mask[i] = !(distr(generator) <= sparsity_);
+    }
+}
+
+ZipfPattern::ZipfPattern(float sparsity, double exponent, uint32_t seed) :
+    sparsity_(sparsity),
+    exponent_(exponent),
+    generator_(seed) {
+    check_sparsity(sparsity_);
+    if (exponent_ < 0.0) {
+        throw std::invalid_argument("Zipf exponent must be non-negative");
+    }
+}
+
+void ZipfPattern::prepare(size_t num_blocks) {
+    // Unnormalized popularity of each rank
+    std::vector<double> weight(num_blocks);
+    for (size_t r = 0; r != num_blocks; ++r) {
+        weight[r] = std::pow(static_cast<double>(r + 1), -exponent_);
+    }
+
+    // Find the scale such that the expected number of nonzero blocks
+    // matches the sparsity. Probabilities are capped at 1, so the
+    // expected count is monotonic in the scale and bisection works
+    const double target = (1.0 - sparsity_) * num_blocks;
+    auto expected = [&weight](double scale) {
+        double sum = 0.0;
+        for (double w : weight) {
+            sum += std::min(1.0, scale * w);
+        }
+        return sum;
+    };
+    double lo = 0.0;
+    double hi = std::pow(static_cast<double>(num_blocks), exponent_);
+    for (uint32_t i = 0; i != 100; ++i) {
+        double mid = (lo + hi) / 2;
+        if (expected(mid) < target) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    // Hot blocks are spread over the data in a random order
+    std::vector<size_t> rank(num_blocks);
+    std::iota(rank.begin(), rank.end(), 0);
+    std::shuffle(rank.begin(), rank.end(), generator_);
+
+    probability_.resize(num_blocks);
+    for (size_t b = 0; b != num_blocks; ++b) {
+        probability_[b] = std::min(1.0, hi * weight[rank[b]]);
+    }
+}
+
+void ZipfPattern::generate(std::vector<char>& mask, std::mt19937& generator) {
+    if (probability_.size() != mask.size()) {
+        throw std::logic_error("Pattern must be prepared for this number of blocks");
+    }
+    std::uniform_real_distribution<> distr(0.0, 1.0);
+    for (size_t i = 0; i != mask.size(); ++i) {
+        mask[i] = distr(generator) < probability_[i];
+    }
+}
+
+BurstyPattern::BurstyPattern(float sparsity, double burst_length) :
+    sparsity_(sparsity),
+    burst_length_(burst_length) {
+    check_sparsity(sparsity_);
+    if (burst_length_ < 1.0) {
+        throw std::invalid_argument("Burst length must be at least 1");
+    }
+}
+
+void BurstyPattern::generate(std::vector<char>& mask, std::mt19937& generator) {
+    std::uniform_real_distribution<> distr(0.0, 1.0);
+    const double density = 1.0 - sparsity_;
+    // Two-state Markov chain. A burst ends with probability 1 / burst_length,
+    // and a new burst starts with the probability that makes the stationary
+    // fraction of nonzero blocks equal to the density. If bursts are too long
+    // for the density, the gaps cannot get any shorter than one block
+    const double stop = (sparsity_ == 0.0) ? 0.0 : 1.0 / burst_length_;
+    const double start = (sparsity_ == 0.0)
+        ? 1.0
+        : std::min(1.0, density * stop / sparsity_);
+
+    bool nonzero = distr(generator) < density;
+    for (size_t i = 0; i != mask.size(); ++i) {
+        mask[i] = nonzero;
+        nonzero = nonzero ? !(distr(generator) < stop) : (distr(generator) < start);
+    }
+}
+
+CorrelatedPattern::CorrelatedPattern(SparsityPattern& base,
+                                     float correlation,
+                                     uint32_t seed) :
+    base_(base),
+    correlation_(correlation),
+    generator_(seed) {
+    if (correlation_ < 0.0 || correlation_ > 1.0) {
+        throw std::invalid_argument("Correlation must be between 0 and 1");
+    }
+}
+
+void CorrelatedPattern::prepare(size_t num_blocks) {
+    base_.prepare(num_blocks);
+    shared_.resize(num_blocks);
+    base_.generate(shared_, generator_);
+}
+
+void CorrelatedPattern::generate(std::vector<char>& mask, std::mt19937& generator) {
+    if (shared_.size() != mask.size()) {
+        throw std::logic_error("Pattern must be prepared for this number of blocks");
+    }
+    base_.generate(mask, generator);
+    std::uniform_real_distribution<> distr(0.0, 1.0);
+    for (size_t i = 0; i != mask.size(); ++i) {
+        if (distr(generator) < correlation_) {
+            mask[i] = shared_[i];
+        }
+    }
+}
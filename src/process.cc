@@ -0,0 +1,224 @@
+#include <new>
+#include <cassert>
+
+#include "process.h"
+#include "utils.h"
+
+namespace FramePool {
+
+// Free frames of each size class, freed with the thread
+struct FreeLists {
+    std::vector<void*> lists_[MAX_POOLED_FRAME_SIZE / FRAME_ALIGNMENT];
+
+    ~FreeLists() {
+        for (std::vector<void*>& list : lists_) {
+            for (void* frame : list) {
+                ::operator delete(frame);
+            }
+        }
+    }
+};
+
+static FreeLists& free_lists() {
+    static thread_local FreeLists lists;
+    return lists;
+}
+
+// Index of the size class of a frame, frames of class k have
+// (k + 1) * FRAME_ALIGNMENT bytes
+static size_t size_class(size_t bytes) {
+    return (bytes + FRAME_ALIGNMENT - 1) / FRAME_ALIGNMENT - 1;
+}
+
+void* allocate(size_t bytes) {
+    if (bytes == 0 || bytes > MAX_POOLED_FRAME_SIZE) {
+        return ::operator new(bytes);
+    }
+    const size_t k = size_class(bytes);
+    std::vector<void*>& list = free_lists().lists_[k];
+    if (list.empty()) {
+        return ::operator new((k + 1) * FRAME_ALIGNMENT);
+    }
+    void* frame = list.back();
+    list.pop_back();
+    return frame;
+}
+
+void deallocate(void* frame, size_t bytes) {
+    if (bytes == 0 || bytes > MAX_POOLED_FRAME_SIZE) {
+        ::operator delete(frame);
+        return;
+    }
+    free_lists().lists_[size_class(bytes)].push_back(frame);
+}
+
+}
+
+Process Process::promise_type::get_return_object() {
+    return Process(std::coroutine_handle<promise_type>::from_promise(*this));
+}
+
+std::suspend_always Process::promise_type::initial_suspend() noexcept {
+    return {};
+}
+
+bool Process::promise_type::FinalAwaiter::await_ready() noexcept {
+    return false;
+}
+
+void Process::promise_type::FinalAwaiter::await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+    promise_type& promise = handle.promise();
+    if (promise.prev_ != nullptr) {
+        promise.prev_->next_ = promise.next_;
+    } else {
+        promise.scheduler_->live_ = promise.next_;
+    }
+    if (promise.next_ != nullptr) {
+        promise.next_->prev_ = promise.prev_;
+    }
+    handle.destroy();
+}
+
+void Process::promise_type::FinalAwaiter::await_resume() noexcept {
+}
+
+Process::promise_type::FinalAwaiter Process::promise_type::final_suspend() noexcept {
+    return {};
+}
+
+void Process::promise_type::return_void() {
+}
+
+void Process::promise_type::unhandled_exception() {
+    if (!scheduler_->exception_) {
+        scheduler_->exception_ = std::current_exception();
+    }
+}
+
+void* Process::promise_type::operator new(size_t bytes) {
+    return FramePool::allocate(bytes);
+}
+
+void Process::promise_type::operator delete(void* frame, size_t bytes) {
+    FramePool::deallocate(frame, bytes);
+}
+
+Process::Process(std::coroutine_handle<promise_type> handle) :
+    handle_(handle) {
+}
+
+Process::Process(Process&& other) :
+    handle_(other.handle_) {
+    other.handle_ = nullptr;
+}
+
+Process::~Process() {
+    // A process that was never spawned has not started
+    if (handle_) {
+        handle_.destroy();
+    }
+}
+
+Scheduler::Scheduler(timestamp_t start) :
+    time_(start),
+    num_scheduled_(0),
+    live_(nullptr) {
+}
+
+Scheduler::~Scheduler() {
+    while (live_ != nullptr) {
+        Process::promise_type* promise = live_;
+        live_ = promise->next_;
+        ProcessHandle::from_promise(*promise).destroy();
+    }
+}
+
+void Scheduler::spawn(Process process, uint64_t priority) {
+    ProcessHandle handle = process.handle_;
+    process.handle_ = nullptr;
+    Process::promise_type& promise = handle.promise();
+    promise.scheduler_ = this;
+    promise.priority_ = priority;
+    promise.next_ = live_;
+    if (live_ != nullptr) {
+        live_->prev_ = &promise;
+    }
+    live_ = &promise;
+    wake(handle, time_);
+}
+
+void Scheduler::run() {
+    while (!wakeups_.empty()) {
+        const Wakeup w = wakeups_.top();
+        wakeups_.pop();
+        time_ = w.time_;
+        w.handle_.resume();
+        if (exception_) {
+            std::exception_ptr exception = exception_;
+            exception_ = nullptr;
+            std::rethrow_exception(exception);
+        }
+    }
+}
+
+timestamp_t Scheduler::now() const {
+    return time_;
+}
+
+void Scheduler::wake(ProcessHandle handle, timestamp_t time) {
+    debug_assert(time >= time_);
+    wakeups_.push({time, handle.promise().priority_, num_scheduled_++, handle});
+}
+
+bool Scheduler::Delay::await_ready() const noexcept {
+    return delta_ == 0;
+}
+
+void Scheduler::Delay::await_suspend(ProcessHandle handle) const {
+    scheduler_.wake(handle, scheduler_.now() + delta_);
+}
+
+void Scheduler::Delay::await_resume() const noexcept {
+}
+
+Scheduler::Delay Scheduler::delay(timedelta_t delta) {
+    return Delay{*this, delta};
+}
+
+bool Scheduler::Wakeup::operator>(const Wakeup& other) const {
+    if (time_ != other.time_) {
+        return time_ > other.time_;
+    }
+    if (priority_ != other.priority_) {
+        return priority_ > other.priority_;
+    }
+    return order_ > other.order_;
+}
+
+Barrier::Barrier(Scheduler& scheduler, uint32_t count) :
+    scheduler_(scheduler),
+    count_(count) {
+}
+
+bool Barrier::Arrive::await_ready() const noexcept {
+    return false;
+}
+
+bool Barrier::Arrive::await_suspend(ProcessHandle handle) const {
+    if (barrier_.waiting_.size() + 1 < barrier_.count_) {
+        barrier_.waiting_.push_back(handle);
+        return true;
+    }
+    for (ProcessHandle waiting : barrier_.waiting_) {
+        barrier_.scheduler_.wake(waiting, barrier_.scheduler_.now());
+    }
+    barrier_.waiting_.clear();
+    return false;
+}
+
+void Barrier::Arrive::await_resume() const noexcept {
+}
+
+Barrier::Arrive Barrier::arrive_and_wait() {
+    return Arrive{*this};
+}
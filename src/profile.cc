@@ -0,0 +1,166 @@
+#ifdef PROFILING
+
+#include <cstdio>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <algorithm>
+
+#include "profile.h"
+
+// Durations are counted in buckets: 4 buckets per power of two, so that
+// percentiles are accurate to within 25%
+static constexpr size_t sub_buckets = 4;
+static constexpr size_t num_buckets = 64 * sub_buckets;
+
+struct ScopeStats {
+    uint64_t calls_ = 0;
+    uint64_t total_ = 0;
+    std::vector<uint64_t> histogram_ = std::vector<uint64_t>(num_buckets, 0);
+
+    void add(const ScopeStats& other) {
+        calls_ += other.calls_;
+        total_ += other.total_;
+        for (size_t b = 0; b != num_buckets; ++b) {
+            histogram_[b] += other.histogram_[b];
+        }
+    }
+};
+
+static size_t bucket(uint64_t ticks) {
+    if (ticks < sub_buckets) {
+        return ticks;
+    }
+    const size_t exponent = 63 - __builtin_clzll(ticks);
+    const size_t fraction = (ticks >> (exponent - 2)) & (sub_buckets - 1);
+    return (exponent - 1) * sub_buckets + fraction;
+}
+
+// Largest duration that falls into the given bucket
+static uint64_t bucket_limit(size_t b) {
+    if (b < sub_buckets) {
+        return b;
+    }
+    const size_t exponent = b / sub_buckets + 1;
+    const uint64_t fraction = b % sub_buckets;
+    return ((sub_buckets + fraction + 1) << (exponent - 2)) - 1;
+}
+
+struct ThreadStats;
+
+// Scope names and the statistics of all threads. Never destroyed, so that
+// threads that exit late can still report to it
+struct Registry {
+    std::mutex mutex_;
+    std::vector<std::string> names_;
+
+    // Statistics of running threads, and totals of threads that exited
+    std::vector<ThreadStats*> threads_;
+    std::vector<ScopeStats> retired_;
+
+    Registry();
+};
+
+static Registry& registry() {
+    static Registry* r = new Registry();
+    return *r;
+}
+
+// Statistics of one thread, updated without locking
+struct ThreadStats {
+    std::vector<ScopeStats> scopes_;
+
+    ThreadStats() {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex_);
+        r.threads_.push_back(this);
+    }
+
+    ~ThreadStats() {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex_);
+        if (r.retired_.size() < scopes_.size()) {
+            r.retired_.resize(scopes_.size());
+        }
+        for (size_t i = 0; i != scopes_.size(); ++i) {
+            r.retired_[i].add(scopes_[i]);
+        }
+        r.threads_.erase(std::find(r.threads_.begin(), r.threads_.end(), this));
+    }
+};
+
+static thread_local ThreadStats thread_stats;
+
+// Threads that are still running at exit are idle by then, so their
+// statistics can be read without racing with them
+static void report() {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex_);
+    std::vector<ScopeStats> totals(r.names_.size());
+    for (size_t i = 0; i != r.retired_.size(); ++i) {
+        totals[i].add(r.retired_[i]);
+    }
+    for (const ThreadStats* t : r.threads_) {
+        for (size_t i = 0; i != t->scopes_.size(); ++i) {
+            totals[i].add(t->scopes_[i]);
+        }
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    const char* unit = "cycles";
+#else
+    const char* unit = "ns";
+#endif
+    std::fprintf(stderr, "Profile (%s, including nested scopes)\n", unit);
+    std::fprintf(stderr, "%-32s %12s %16s %12s %12s\n", "scope", "calls", "total", "mean", "p99");
+    for (size_t i = 0; i != totals.size(); ++i) {
+        const ScopeStats& s = totals[i];
+        if (s.calls_ == 0) {
+            continue;
+        }
+        // Smallest bucket below which at least 99% of the calls fall
+        const uint64_t rank = (s.calls_ * 99 + 99) / 100;
+        uint64_t seen = 0;
+        size_t b = 0;
+        for (; b != num_buckets; ++b) {
+            seen += s.histogram_[b];
+            if (seen >= rank) {
+                break;
+            }
+        }
+        std::fprintf(stderr, "%-32s %12llu %16llu %12.1f %12llu\n",
+                     r.names_[i].c_str(),
+                     static_cast<unsigned long long>(s.calls_),
+                     static_cast<unsigned long long>(s.total_),
+                     static_cast<double>(s.total_) / s.calls_,
+                     static_cast<unsigned long long>(bucket_limit(b)));
+    }
+}
+
+Registry::Registry() {
+    std::atexit(report);
+}
+
+size_t Profiler::id(const char* name) {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex_);
+    auto it = std::find(r.names_.begin(), r.names_.end(), name);
+    if (it != r.names_.end()) {
+        return it - r.names_.begin();
+    }
+    r.names_.push_back(name);
+    return r.names_.size() - 1;
+}
+
+void Profiler::record(size_t id, uint64_t ticks) {
+    std::vector<ScopeStats>& scopes = thread_stats.scopes_;
+    if (id >= scopes.size()) {
+        scopes.resize(id + 1);
+    }
+    ScopeStats& s = scopes[id];
+    ++s.calls_;
+    s.total_ += ticks;
+    ++s.histogram_[bucket(ticks)];
+}
+
+#endif
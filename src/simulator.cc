@@ -1,115 +1,722 @@
 #include <cassert>
 #include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <limits>
+#include <cmath>
 
 #include "simulator.h"
 #include "worker.h"
 #include "utils.h"
+#include "profile.h"
 
 uint64_t computation_time = 0;
 uint64_t network_time = 0;
 
-Simulator::Simulator(workernum_t num_workers, uint32_t block_size, uint32_t bf_width) :
-    aggregator_(num_workers, block_size, bf_width),
+// Number of elements checked by one task during verification
+static constexpr size_t verify_chunk = 1UL << 16;
+
+// Remove and return the earliest event of a queue
+template <typename Queue>
+static Event pop_event(Queue& events) {
+    PROFILE_SCOPE("event queue pop");
+    const Event e = events.top();
+    events.pop();
+    return e;
+}
+
+template <typename T>
+Simulator<T>::Simulator(workernum_t num_workers,
+                     uint32_t block_size,
+                     uint32_t bf_width,
+                     Collective collective,
+                     Protocol protocol) :
+    aggregator_(num_workers, block_size, bf_width, collective, protocol),
     block_size_(block_size),
     bf_width_(bf_width),
-    time_(0) {
+    collective_(collective),
+    time_(0),
+    lossy_(false),
+    timeout_(DEFAULT_TIMEOUT),
+    loss_seed_(0),
+    lost_packets_(0),
+    retransmissions_(0),
+    num_partitions_(0) {
     // Initialize all workers
     for (workernum_t worker_id = 0; worker_id != num_workers; ++worker_id) {
-        Worker w = {worker_id, block_size, bf_width};
+        Worker<T> w = {worker_id, block_size, bf_width, collective, protocol};
         workers_.push_back(w);
     }
     // Fake event to kickstart the simulator
     events_.push(Event(INIT_EVENT, 0, 0, 0));
 }
 
-void Simulator::generate_data(size_t size, uint32_t block_size, float sparsity) {
+template <typename T>
+void Simulator<T>::seed(uint32_t seed) {
+    // Derive a different seed for each worker, so that workers do not
+    // generate identical data
+    std::seed_seq seq{seed};
+    std::vector<uint32_t> seeds(workers_.size());
+    seq.generate(seeds.begin(), seeds.end());
+    for (Worker<T>& w : workers_) {
+        w.seed(seeds[w.id_]);
+    }
+}
+
+template <typename T>
+void Simulator<T>::generate_data(size_t size, uint32_t block_size, float sparsity) {
+    UniformPattern pattern(sparsity);
+    generate_data(size, block_size, pattern);
+}
+
+template <typename T>
+void Simulator<T>::generate_data(size_t size, uint32_t block_size, SparsityPattern& pattern) {
     // For now, to keep things a bit simpler, we require that data size
     // be a multiple of block size
     if (size % block_size_ != 0) {
         throw std::invalid_argument("Data size must be multiple of block size");
     }
-    for (Worker& w : workers_) {
-        w.generate_data(size, block_size, sparsity);
+    const size_t num_blocks = size / block_size;
+    pattern.prepare(num_blocks);
+    for (Worker<T>& w : workers_) {
+        w.generate_data(size, block_size, pattern);
+        if (collective_ != ALLREDUCE) {
+            w.set_shard(shard_begin(w.id_, num_blocks), shard_begin(w.id_ + 1, num_blocks));
+        }
+    }
+    // The reference no longer matches the data
+    reference_.clear();
+#ifdef VERIFY_RESULTS
+    prepare_verification();
+#endif
+}
+
+template <typename T>
+void Simulator<T>::set_sparse_data(workernum_t worker,
+                                   size_t size,
+                                   const std::vector<uint64_t>& indices,
+                                   const std::vector<T>& values) {
+    Worker<T>& w = workers_.at(worker);
+    w.set_sparse_data(size, indices, values);
+    set_shard(w);
+}
+
+template <typename T>
+void Simulator<T>::set_sparse_data(workernum_t worker,
+                                   size_t rows,
+                                   size_t cols,
+                                   const std::vector<uint64_t>& row_ptr,
+                                   const std::vector<uint64_t>& col_idx,
+                                   const std::vector<T>& values) {
+    Worker<T>& w = workers_.at(worker);
+    w.set_sparse_data(rows, cols, row_ptr, col_idx, values);
+    set_shard(w);
+}
+
+template <typename T>
+void Simulator<T>::set_shard(Worker<T>& worker) {
+    // The reference no longer matches the data
+    reference_.clear();
+    if (collective_ != ALLREDUCE) {
+        const size_t num_blocks = worker.gradients().size() / block_size_;
+        worker.set_shard(shard_begin(worker.id_, num_blocks),
+                         shard_begin(worker.id_ + 1, num_blocks));
+    }
+}
+
+template <typename T>
+Simulator<T>::LogicalProcess::LogicalProcess() :
+    time_(0),
+    computation_time_(0),
+    network_time_(0) {
+}
+
+template <typename T>
+void Simulator<T>::set_sparsifier(const Sparsifier& sparsifier) {
+    for (Worker<T>& w : workers_) {
+        w.set_sparsifier(sparsifier);
+    }
+}
+
+template <typename T>
+bool Simulator<T>::sparsify() {
+    bool changed = false;
+    for (Worker<T>& w : workers_) {
+        changed |= w.sparsify();
+    }
+    if (changed) {
+        // The reference no longer matches the data
+        reference_.clear();
+    }
+    return changed;
+}
+
+template <typename T>
+void Simulator<T>::set_parallel_threshold(size_t threshold) {
+    for (Worker<T>& w : workers_) {
+        w.set_parallel_threshold(threshold);
+    }
+    aggregator_.set_parallel_threshold(threshold);
+}
+
+template <typename T>
+void Simulator<T>::set_adaptive_width(bool adaptive) {
+    for (Worker<T>& w : workers_) {
+        w.set_adaptive_width(adaptive);
+    }
+    aggregator_.set_adaptive_width(adaptive);
+}
+
+template <typename T>
+void Simulator<T>::set_slot_pool(uint32_t num_slots, uint32_t slot_size) {
+    aggregator_.set_slot_pool(num_slots, slot_size);
+}
+
+template <typename T>
+void Simulator<T>::set_loss(double probability, timedelta_t timeout, uint32_t seed) {
+    if (timeout == 0) {
+        throw std::invalid_argument("Timeout must be positive");
+    }
+    timeout_ = timeout;
+    loss_seed_ = seed;
+    for (Worker<T>& w : workers_) {
+        w.set_loss(probability, seed);
+    }
+    lossy_ = probability > 0.0;
+    aggregator_.set_lossy(lossy_);
+}
+
+template <typename T>
+void Simulator<T>::set_link_loss(workernum_t worker, double probability) {
+    workers_.at(worker).set_loss(probability, loss_seed_);
+    lossy_ = lossy_ || probability > 0.0;
+    aggregator_.set_lossy(lossy_);
+}
+
+template <typename T>
+void Simulator<T>::start() {
+    lost_packets_ = 0;
+    retransmissions_ = 0;
+    sparsify();
+#ifdef VERIFY_RESULTS
+    if (reference_.empty()) {
+        prepare_verification();
+    }
+#endif
+    // Every run but the first starts a new collective when the previous one ended
+    if (events_.empty()) {
+        aggregator_.restart();
+        events_.push(Event(INIT_EVENT, 0, time_, time_));
+    }
+}
+
+template <typename T>
+void Simulator<T>::run() {
+    start();
+    num_partitions_ = 0;
+    std::vector<LogicalProcess> lps(1);
+    lps[0].time_ = time_;
+    std::swap(lps[0].events_, events_);
+
+    EventQueue& events = lps[0].events_;
+    while (!events.empty()) {
+        const Event e = pop_event(events);
+        handle(e, lps, 0);
     }
+    finish(lps);
 }
 
-void Simulator::run() {
+template <typename T>
+void Simulator<T>::run_parallel(uint32_t num_threads) {
+    if (num_threads == 0) {
+        throw std::invalid_argument("Number of threads must be positive");
+    }
+    if (lossy_) {
+        // Packets sent again would be read by the aggregator's logical
+        // process while the worker's process prepares new ones
+        throw std::logic_error("Packet loss is only simulated by run");
+    }
+    start();
+    num_partitions_ = std::min<uint32_t>(num_threads, workers_.size());
+    std::vector<LogicalProcess> lps(num_partitions_ + 1);
+    for (LogicalProcess& lp : lps) {
+        lp.time_ = time_;
+    }
+
+    // The initial event starts all workers without crossing the network,
+    // so each worker partition gets its own copy of it
     while (!events_.empty()) {
-        const Event& e = events_.top();
-        Worker& worker = workers_[e.worker_id_];
+        const Event e = events_.top();
+        events_.pop();
+        if (e.type_ == INIT_EVENT) {
+            for (size_t lp = 1; lp != lps.size(); ++lp) {
+                lps[lp].events_.push(Event(INIT_EVENT, first_worker(lp),
+                                           e.start_timestamp_, e.end_timestamp_));
+            }
+        } else {
+            lps[owner(e)].events_.push(e);
+        }
+    }
 
-        // Sanity checks
-        debug_assert(e.start_timestamp_ <= time_);
-        debug_assert(e.worker_id_ < workers_.size());
-        debug_assert(e.end_timestamp_ >= time_);
-        debug_assert(worker.id_ == e.worker_id_);
+    ThreadPool pool(num_threads);
+    while (true) {
+        // Every event scheduled for another logical process is at least
+        // one link latency in the future, so all events before the end
+        // of the window can be processed without waiting for the others
+        timestamp_t window_start = TIME_INF;
+        for (const LogicalProcess& lp : lps) {
+            if (!lp.events_.empty()) {
+                window_start = std::min(window_start, lp.events_.top().end_timestamp_);
+            }
+        }
+        if (window_start == TIME_INF) {
+            break;
+        }
+        const timestamp_t window_end = window_start + LINK_LATENCY;
+
+        pool.parallel_for(lps.size(), [this, &lps, window_end](size_t lp) {
+            EventQueue& events = lps[lp].events_;
+            while (!events.empty() && events.top().end_timestamp_ < window_end) {
+                const Event e = pop_event(events);
+                handle(e, lps, lp);
+            }
+        });
+
+        for (LogicalProcess& lp : lps) {
+            for (const Event& e : lp.outbox_) {
+                debug_assert(e.end_timestamp_ >= window_end);
+                lps[owner(e)].events_.push(e);
+            }
+            lp.outbox_.clear();
+        }
+    }
+    finish(lps);
+}
+
+template <typename T>
+void Simulator<T>::run_processes() {
+    if (lossy_) {
+        // Timers would run alongside the straight-line protocol
+        throw std::logic_error("Packet loss is only simulated by run");
+    }
+    start();
+    num_partitions_ = 0;
+    std::vector<LogicalProcess> lps(1);
+    lps[0].time_ = time_;
+    // The processes start where the initial event would
+    events_ = EventQueue();
 
-        // Advance time
-        time_ = e.end_timestamp_;
+    Scheduler scheduler(time_);
+    Mailbox<workernum_t> aggregator_inbox(scheduler);
+    std::deque<Mailbox<timedelta_t>> worker_inboxes;
+    for (Worker<T>& w : workers_) {
+        worker_inboxes.emplace_back(scheduler);
+        // Like events, workers act in the order of their IDs at the same time,
+        // which decides the order in which packets reach the aggregator
+        scheduler.spawn(worker_process(scheduler, w, worker_inboxes.back(), aggregator_inbox, lps[0]),
+                        w.id_);
+    }
+    scheduler.spawn(aggregator_process(scheduler, aggregator_inbox, worker_inboxes, lps[0]),
+                    workers_.size());
+    scheduler.run();
+    lps[0].time_ = scheduler.now();
+    finish(lps);
+}
+
+template <typename T>
+Process Simulator<T>::worker_process(Scheduler& scheduler,
+                                     Worker<T>& worker,
+                                     Mailbox<timedelta_t>& inbox,
+                                     Mailbox<workernum_t>& aggregator_inbox,
+                                     LogicalProcess& lp) {
+    timedelta_t delta = worker.start();
+    lp.computation_time_ += delta;
+    co_await scheduler.delay(delta);
+    while (true) {
+        delta = worker.prepare_to_send();
+        // Nothing to send if the aggregator did not request any of the
+        // worker's blocks
+        if (delta != TIME_NOW) {
+            if (worker.id_ == 0) {
+                lp.network_time_ += delta;
+            }
+            co_await scheduler.delay(delta);
+            // The aggregator processes the packet as soon as it arrives
+            delta = worker.send(aggregator_);
+            lp.computation_time_ += delta;
+            co_await scheduler.delay(delta);
+            aggregator_inbox.put(worker.id_);
+        }
+        if (worker.finished()) {
+            co_return;
+        }
+        delta = co_await inbox.receive();
+        co_await scheduler.delay(delta);
+        delta = worker.process_response();
+        lp.computation_time_ += delta;
+        co_await scheduler.delay(delta);
+    }
+}
+
+template <typename T>
+Process Simulator<T>::aggregator_process(Scheduler& scheduler,
+                                         Mailbox<workernum_t>& inbox,
+                                         std::deque<Mailbox<timedelta_t>>& worker_inboxes,
+                                         LogicalProcess& lp) {
+    do {
+        // Wait for the packets of all workers that send in this round
         timedelta_t delta;
-        verbose_print("[TIMESTAMP: " << time_ << "]" << std::endl);
-        switch (e.type_) {
-            case INIT_EVENT:
-                // Workers will first prepare to send
-                for (Worker& w : workers_) {
-                    events_.push(Event(WORKER_PREPARE, w.id_, time_, time_));
+        do {
+            const workernum_t w = co_await inbox.receive();
+            delta = aggregator_.process_response(w);
+        } while (!aggregator_.all_received());
+        lp.computation_time_ += delta;
+        co_await scheduler.delay(delta);
+
+        delta = aggregator_.prepare_to_send();
+        lp.network_time_ += delta;
+        co_await scheduler.delay(delta);
+
+        // All workers receive the result at once
+        for (Worker<T>& w : workers_) {
+            delta = aggregator_.send(w);
+            lp.computation_time_ += delta;
+            worker_inboxes[w.id_].put(delta);
+        }
+        // No worker sends in the next round once all blocks are done
+    } while (!aggregator_.all_received());
+}
+
+template <typename T>
+size_t Simulator<T>::owner(const Event& e) const {
+    if (num_partitions_ == 0) {
+        return 0;
+    }
+    switch (e.type_) {
+        case INIT_EVENT:
+        case WORKER_PROCESS:
+        case WORKER_PREPARE:
+        case AGGREGATOR_SEND:
+        case WORKER_TIMEOUT:
+        case AGGREGATOR_RESEND:
+            // Workers are split into contiguous ranges
+            return 1 + static_cast<uint64_t>(e.worker_id_) * num_partitions_ / workers_.size();
+        default:
+            // Sending to the aggregator reads the worker's packet, but the
+            // worker does not touch it until the aggregator responds
+            return 0;
+    }
+}
+
+template <typename T>
+workernum_t Simulator<T>::first_worker(size_t lp) const {
+    if (num_partitions_ == 0) {
+        return lp == 0 ? 0 : workers_.size();
+    }
+    // Inverse of the partitioning in owner
+    return ((lp - 1) * workers_.size() + num_partitions_ - 1) / num_partitions_;
+}
+
+template <typename T>
+void Simulator<T>::schedule(const Event& e, std::vector<LogicalProcess>& lps, size_t lp) {
+    PROFILE_SCOPE("event queue push");
+    if (owner(e) == lp) {
+        lps[lp].events_.push(e);
+    } else {
+        lps[lp].outbox_.push_back(e);
+    }
+}
+
+template <typename T>
+void Simulator<T>::handle(const Event& e, std::vector<LogicalProcess>& lps, size_t lp) {
+    LogicalProcess& self = lps[lp];
+    Worker<T>& worker = workers_[e.worker_id_];
+
+    // Sanity checks
+    debug_assert(e.start_timestamp_ <= e.end_timestamp_);
+    debug_assert(e.worker_id_ < workers_.size());
+    debug_assert(e.end_timestamp_ >= self.time_);
+    debug_assert(worker.id_ == e.worker_id_);
+
+    // A timer whose round has ended does nothing, and
+    // in particular does not extend the simulation
+    if (e.type_ == WORKER_TIMEOUT && !worker.waiting(e.seq_)) {
+        return;
+    }
+
+    // Advance time
+    self.time_ = e.end_timestamp_;
+    const uint64_t time = self.time_;
+    timedelta_t delta;
+    verbose_print("[TIMESTAMP: " << time << "]" << std::endl);
+    switch (e.type_) {
+        case INIT_EVENT: {
+            PROFILE_SCOPE("handle INIT_EVENT");
+            // Workers will first prepare to send. They all start at once,
+            // so they prepare right away instead of through an event each,
+            // unless they need time to sparsify their gradients first
+            for (workernum_t w = first_worker(lp); w != first_worker(lp + 1); ++w) {
+                delta = workers_[w].start();
+                if (delta == TIME_NOW) {
+                    prepare(workers_[w], lps, lp);
+                } else {
+                    schedule(Event(WORKER_PREPARE, w, time, time + delta), lps, lp);
+                    self.computation_time_ += delta;
                 }
-                break;
-            case WORKER_PROCESS:
-                // Once the worker processed the packet, prepare for sending
-                delta = worker.process_response();
-                events_.push(Event(WORKER_PREPARE, worker.id_, time_, time_ + delta));
-                computation_time += delta;
-                break;
-            case WORKER_PREPARE:
-                delta = worker.prepare_to_send();
-                // If preparation is immediate, requested packet is of lower number than the
-                // worker's next nonzero block, so don't send anything
-                if (delta != TIME_NOW) {
-                    events_.push(Event(WORKER_SEND, worker.id_, time_, time_ + delta));
-                    if (worker.id_ == 0) {
-                        network_time += delta;
-                    }
+            }
+            break;
+        }
+        case WORKER_PROCESS: {
+            PROFILE_SCOPE("handle WORKER_PROCESS");
+            // Once the worker processed the packet, prepare for sending
+            delta = worker.process_response();
+            schedule(Event(WORKER_PREPARE, worker.id_, time, time + delta), lps, lp);
+            self.computation_time_ += delta;
+            break;
+        }
+        case WORKER_PREPARE: {
+            PROFILE_SCOPE("handle WORKER_PREPARE");
+            prepare(worker, lps, lp);
+            break;
+        }
+        case WORKER_SEND: {
+            PROFILE_SCOPE("handle WORKER_SEND");
+            if (lossy_) {
+                if (worker.uplink_lost()) {
+                    ++lost_packets_;
+                    break;
                 }
-                break;
-            case WORKER_SEND:
-                // Once the worker sends the packet, aggregator should process it
-                delta = worker.send(aggregator_);
-                events_.push(Event(AGGREGATOR_PROCESS, worker.id_, time_, time_ + delta));
-                computation_time += delta;
-                break;
-            case AGGREGATOR_PROCESS:
-                delta = aggregator_.process_response(worker.id_);
-                // Once the aggregator processes the packet, it should prepare to send,
-                // but only if all required workers sent their packets
-                if (aggregator_.all_received()) {
-                    events_.push(Event(AGGREGATOR_PREPARE, worker.id_, time_, time_ + delta));
-                    computation_time += delta;
+                if (e.seq_ < aggregator_.get_seq()) {
+                    // The worker missed the result of an earlier round
+                    delta = aggregator_.resend_time(e.seq_);
+                    schedule(Event(AGGREGATOR_RESEND, worker.id_, time, time + delta, e.seq_), lps, lp);
+                    self.network_time_ += delta;
+                    break;
                 }
-                break;
-            case AGGREGATOR_PREPARE:
-                // Once the aggregator prepared to send, it multicasts the packet to all workers
-                delta = aggregator_.prepare_to_send();
-                for (Worker& w : workers_) {
-                    events_.push(Event(AGGREGATOR_SEND, w.id_, time_, time_ + delta));
+                if (!worker.has_payload() || !aggregator_.accepts(worker.id_)) {
+                    // Asks for the result of the current round, which is
+                    // not ready yet, or has been received before
+                    break;
                 }
-                network_time += delta;
-                break;
-            case AGGREGATOR_SEND:
-                // Once a worker receives the block, it processes it
-                delta = aggregator_.send(worker);
-                // Reset per-round aggregator state if packets have been sent to all workers
-                if (aggregator_.all_sent()) {
-                    aggregator_.reset();
+            }
+            // Once the worker sends the packet, aggregator should process it
+            delta = worker.send(aggregator_);
+            schedule(Event(AGGREGATOR_PROCESS, worker.id_, time, time + delta), lps, lp);
+            self.computation_time_ += delta;
+            break;
+        }
+        case AGGREGATOR_PROCESS: {
+            PROFILE_SCOPE("handle AGGREGATOR_PROCESS");
+            delta = aggregator_.process_response(worker.id_);
+            // Once the aggregator processes the packet, it should prepare to send,
+            // but only if all required workers sent their packets
+            if (aggregator_.all_received()) {
+                schedule(Event(AGGREGATOR_PREPARE, worker.id_, time, time + delta), lps, lp);
+                self.computation_time_ += delta;
+            }
+            break;
+        }
+        case AGGREGATOR_PREPARE: {
+            PROFILE_SCOPE("handle AGGREGATOR_PREPARE");
+            // Once the aggregator prepared to send, it multicasts the packet to all workers.
+            // The multicast is a single event for all workers of a logical process
+            const uint64_t seq = aggregator_.get_seq();
+            delta = aggregator_.prepare_to_send();
+            for (size_t dest = (num_partitions_ != 0); dest != num_partitions_ + 1; ++dest) {
+                schedule(Event(AGGREGATOR_SEND, first_worker(dest), time, time + delta, seq), lps, lp);
+            }
+            self.network_time_ += delta;
+            break;
+        }
+        case AGGREGATOR_SEND: {
+            PROFILE_SCOPE("handle AGGREGATOR_SEND");
+            // Once a worker receives the block, it processes it. All workers
+            // receive the same shared packet at the same time
+            for (workernum_t w = first_worker(lp); w != first_worker(lp + 1); ++w) {
+                if (lossy_ && workers_[w].downlink_lost()) {
+                    ++lost_packets_;
+                    continue;
                 }
-                events_.push(Event(WORKER_PROCESS, worker.id_, time_, time_ + delta));
-                computation_time += delta;
+                if (lossy_ && !workers_[w].waiting(e.seq_)) {
+                    // The worker missed an earlier result, which it asks for first
+                    continue;
+                }
+                delta = aggregator_.send(workers_[w]);
+                schedule(Event(WORKER_PROCESS, w, time, time + delta), lps, lp);
+                self.computation_time_ += delta;
+            }
+            break;
+        }
+        case WORKER_TIMEOUT: {
+            PROFILE_SCOPE("handle WORKER_TIMEOUT");
+            // The result of the round did not arrive in time, so send the packet
+            // again. Without payload, it asks the aggregator for the result
+            ++retransmissions_;
+            delta = worker.resend_time();
+            schedule(Event(WORKER_SEND, worker.id_, time, time + delta, e.seq_), lps, lp);
+            schedule(Event(WORKER_TIMEOUT, worker.id_, time, time + timeout_, e.seq_), lps, lp);
+            break;
+        }
+        case AGGREGATOR_RESEND: {
+            PROFILE_SCOPE("handle AGGREGATOR_RESEND");
+            if (worker.downlink_lost()) {
+                ++lost_packets_;
+                break;
+            }
+            if (!worker.waiting(e.seq_)) {
                 break;
+            }
+            delta = aggregator_.resend(worker, e.seq_);
+            schedule(Event(WORKER_PROCESS, worker.id_, time, time + delta), lps, lp);
+            self.computation_time_ += delta;
+            break;
+        }
+    }
+}
+
+template <typename T>
+void Simulator<T>::prepare(Worker<T>& worker, std::vector<LogicalProcess>& lps, size_t lp) {
+    LogicalProcess& self = lps[lp];
+    const timedelta_t delta = worker.prepare_to_send();
+    // If preparation is immediate, requested packet is of lower number than the
+    // worker's next nonzero block, so don't send anything
+    if (delta != TIME_NOW) {
+        schedule(Event(WORKER_SEND, worker.id_, self.time_, self.time_ + delta, worker.get_seq()), lps, lp);
+        if (worker.id_ == 0) {
+            self.network_time_ += delta;
         }
-        events_.pop();
+    }
+    // Over lossy links, a worker waiting for a result sets a timer,
+    // whether it sent a packet or not
+    if (lossy_ && !worker.finished()) {
+        schedule(Event(WORKER_TIMEOUT, worker.id_, self.time_, self.time_ + timeout_, worker.get_seq()),
+                 lps, lp);
     }
 }
 
-uint64_t Simulator::get_time() {
+template <typename T>
+void Simulator<T>::finish(const std::vector<LogicalProcess>& lps) {
+    for (const LogicalProcess& lp : lps) {
+        time_ = std::max(time_, lp.time_);
+        computation_time += lp.computation_time_;
+        network_time += lp.network_time_;
+    }
+#ifdef VERIFY_RESULTS
+    if (!verify()) {
+        throw std::runtime_error("Allreduce result does not match the reference");
+    }
+#endif
+}
+
+template <typename T>
+uint64_t Simulator<T>::get_time() {
     return time_;
 }
+
+template <typename T>
+void Simulator<T>::prepare_verification() {
+    const size_t size = workers_[0].gradients().size();
+    const size_t num_chunks = (size + verify_chunk - 1) / verify_chunk;
+    reference_.resize(size);
+    ThreadPool::instance().parallel_for(num_chunks, [this, size](size_t chunk) {
+        const size_t begin = chunk * verify_chunk;
+        const size_t end = std::min(size, begin + verify_chunk);
+        double* ref = reference_.data();
+        std::fill(ref + begin, ref + end, 0.0);
+        for (const Worker<T>& w : workers_) {
+            w.add_input(ref, begin, end);
+        }
+    });
+}
+
+template <typename T>
+bool Simulator<T>::verify() const {
+    if (reference_.empty()) {
+        throw std::logic_error("Verification must be prepared before running");
+    }
+    const size_t size = reference_.size();
+    const size_t num_chunks = (size + verify_chunk - 1) / verify_chunk;
+    // The aggregator sums the blocks in the order in which they arrive, so
+    // the result may differ from the reference by the rounding error of
+    // each addition
+    const double tolerance = workers_.size() * ElementTraits<T>::epsilon;
+    const size_t num_blocks = size / block_size_;
+    std::atomic<size_t> mismatches(0);
+    ThreadPool::instance().parallel_for(num_chunks * workers_.size(),
+                                        [&, this](size_t task) {
+        const Buffer<T>& gradients = workers_[task / num_chunks].gradients();
+        if (gradients.size() != size) {
+            ++mismatches;
+            return;
+        }
+        size_t begin = (task % num_chunks) * verify_chunk;
+        size_t end = std::min(size, begin + verify_chunk);
+        if (collective_ == REDUCE_SCATTER) {
+            const workernum_t worker = task / num_chunks;
+            begin = std::max<size_t>(begin, shard_begin(worker, num_blocks) * block_size_);
+            end = std::min<size_t>(end, shard_begin(worker + 1, num_blocks) * block_size_);
+        }
+        const double* __restrict ref = reference_.data();
+        const T* __restrict grad = gradients.data();
+        size_t count = 0;
+        for (size_t i = begin; i < end; ++i) {
+            count += !(std::abs(static_cast<double>(grad[i]) - ref[i]) <=
+                       tolerance * std::max(1.0, std::abs(ref[i])));
+        }
+        mismatches += count;
+    });
+    return mismatches == 0;
+}
+
+template <typename T>
+const Buffer<T>& Simulator<T>::gradients(workernum_t worker) const {
+    return workers_.at(worker).gradients();
+}
+
+template <typename T>
+uint64_t Simulator<T>::get_rounds() const {
+    return aggregator_.get_rounds();
+}
+
+template <typename T>
+double Simulator<T>::get_mean_participation() const {
+    if (aggregator_.get_rounds() == 0) {
+        return 0.0;
+    }
+    return static_cast<double>(aggregator_.get_packets()) / aggregator_.get_rounds();
+}
+
+template <typename T>
+uint64_t Simulator<T>::get_blocks() const {
+    return aggregator_.get_blocks();
+}
+
+template <typename T>
+uint64_t Simulator<T>::get_rejected_blocks() const {
+    return aggregator_.get_rejected_blocks();
+}
+
+template <typename T>
+uint64_t Simulator<T>::get_lost_packets() const {
+    return lost_packets_;
+}
+
+template <typename T>
+uint64_t Simulator<T>::get_retransmissions() const {
+    return retransmissions_;
+}
+
+template <typename T>
+blocknum_t Simulator<T>::shard_begin(workernum_t worker, size_t num_blocks) const {
+    if (collective_ == BROADCAST) {
+        // Worker 0 is the root and owns all blocks
+        return (worker == 0) ? 0 : num_blocks;
+    }
+    // Blocks are split as evenly as possible
+    return static_cast<blocknum_t>(worker) * num_blocks / workers_.size();
+}
+
+template class Simulator<float>;
+template class Simulator<double>;
+template class Simulator<bf16>;
+template class Simulator<int32_t>;
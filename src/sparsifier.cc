@@ -0,0 +1,115 @@
+#include <stdexcept>
+#include <algorithm>
+#include <functional>
+
+#include "sparsifier.h"
+#include "element.h"
+
+Sparsifier::Sparsifier(Mode mode, size_t k, double threshold, bool error_feedback) :
+    mode_(mode),
+    k_(k),
+    threshold_(threshold),
+    error_feedback_(error_feedback) {
+}
+
+Sparsifier Sparsifier::top_k(size_t k, bool error_feedback) {
+    return Sparsifier(TOP_K, k, 0.0, error_feedback);
+}
+
+Sparsifier Sparsifier::threshold(double threshold, bool error_feedback) {
+    if (threshold < 0.0) {
+        throw std::invalid_argument("Sparsification threshold must be non-negative");
+    }
+    return Sparsifier(THRESHOLD, 0, threshold, error_feedback);
+}
+
+template <typename T>
+void Sparsifier::apply(Buffer<T>& gradients, Buffer<T>& residual, uint32_t block_size) const {
+    if (gradients.size() % block_size != 0) {
+        throw std::invalid_argument("Data size must be a multiple of block size");
+    }
+    const size_t num_blocks = gradients.size() / block_size;
+    if (error_feedback_) {
+        if (residual.empty()) {
+            residual.resize(gradients.size(), T(0));
+        } else if (residual.size() != gradients.size()) {
+            throw std::invalid_argument("Residual must have the size of the gradients");
+        }
+        accumulate(gradients.data(), residual.data(), gradients.size());
+    }
+
+    std::vector<double> norms(num_blocks, 0.0);
+    for (size_t b = 0; b != num_blocks; ++b) {
+        const T* block = &gradients[b * block_size];
+        double norm = 0.0;
+        for (uint32_t j = 0; j != block_size; ++j) {
+            const double x = static_cast<double>(block[j]);
+            norm += x * x;
+        }
+        norms[b] = norm;
+    }
+
+    std::vector<char> keep(num_blocks);
+    select(norms, keep);
+    for (size_t b = 0; b != num_blocks; ++b) {
+        T* block = &gradients[b * block_size];
+        if (error_feedback_) {
+            T* dropped = &residual[b * block_size];
+            if (keep[b]) {
+                std::fill(dropped, dropped + block_size, T(0));
+            } else {
+                std::copy(block, block + block_size, dropped);
+            }
+        }
+        if (!keep[b]) {
+            std::fill(block, block + block_size, T(0));
+        }
+    }
+}
+
+void Sparsifier::select(const std::vector<double>& norms, std::vector<char>& keep) const {
+    // Zero blocks are never worth sending
+    if (mode_ == THRESHOLD) {
+        for (size_t b = 0; b != norms.size(); ++b) {
+            keep[b] = norms[b] > 0.0 && norms[b] >= threshold_ * threshold_;
+        }
+        return;
+    }
+    if (k_ == 0) {
+        std::fill(keep.begin(), keep.end(), 0);
+        return;
+    }
+    if (k_ >= norms.size()) {
+        for (size_t b = 0; b != norms.size(); ++b) {
+            keep[b] = norms[b] > 0.0;
+        }
+        return;
+    }
+    // The k-th largest norm, found by partial sorting in linear time
+    std::vector<double> sorted(norms);
+    std::nth_element(sorted.begin(), sorted.begin() + (k_ - 1), sorted.end(), std::greater<double>());
+    const double kth = sorted[k_ - 1];
+    // Blocks above the k-th norm are kept, and ties at the k-th norm
+    // are broken by block order
+    size_t above = 0;
+    for (double norm : norms) {
+        above += norm > kth;
+    }
+    size_t ties = k_ - above;
+    for (size_t b = 0; b != norms.size(); ++b) {
+        if (norms[b] > kth) {
+            keep[b] = 1;
+        } else if (norms[b] == kth && ties > 0) {
+            keep[b] = 1;
+            --ties;
+        } else {
+            keep[b] = 0;
+        }
+        keep[b] = keep[b] && norms[b] > 0.0;
+    }
+}
+
+template void Sparsifier::apply(Buffer<float>&, Buffer<float>&, uint32_t) const;
+template void Sparsifier::apply(Buffer<double>&, Buffer<double>&, uint32_t) const;
+template void Sparsifier::apply(Buffer<bf16>&, Buffer<bf16>&, uint32_t) const;
+template void Sparsifier::apply(Buffer<int32_t>&, Buffer<int32_t>&, uint32_t) const;
@@ -0,0 +1,105 @@
+#include <algorithm>
+
+#include "utils.h"
+
+// Set in threads that are running a loop of a pool
+static thread_local bool in_parallel_for = false;
+
+// Pool of the calling thread, see ThreadPool::set_instance
+static thread_local ThreadPool* local_pool = nullptr;
+
+ThreadPool::ThreadPool(unsigned num_threads) :
+    generation_(0),
+    stop_(false),
+    task_(nullptr),
+    num_tasks_(0),
+    next_task_(0),
+    num_busy_(0) {
+    // The calling thread also runs tasks, so spawn one thread less
+    for (unsigned i = 1; i < num_threads; ++i) {
+        threads_.push_back(std::thread(&ThreadPool::work, this));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    start_.notify_all();
+    for (std::thread& t : threads_) {
+        t.join();
+    }
+}
+
+void ThreadPool::parallel_for(size_t n, const std::function<void(size_t)>& f) {
+    if (in_parallel_for || threads_.empty() || n <= 1) {
+        for (size_t i = 0; i != n; ++i) {
+            f(i);
+        }
+        return;
+    }
+
+    std::lock_guard<std::mutex> loop_lock(loop_mutex_);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        task_ = &f;
+        num_tasks_ = n;
+        next_task_ = 0;
+        num_busy_ = threads_.size();
+        ++generation_;
+    }
+    start_.notify_all();
+
+    in_parallel_for = true;
+    run_tasks();
+    in_parallel_for = false;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] { return num_busy_ == 0; });
+    task_ = nullptr;
+}
+
+unsigned ThreadPool::size() const {
+    return threads_.size() + 1;
+}
+
+ThreadPool& ThreadPool::instance() {
+    if (local_pool != nullptr) {
+        return *local_pool;
+    }
+    static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
+    return pool;
+}
+
+ThreadPool* ThreadPool::set_instance(ThreadPool* pool) {
+    std::swap(local_pool, pool);
+    return pool;
+}
+
+void ThreadPool::work() {
+    in_parallel_for = true;
+    uint64_t seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            start_.wait(lock, [this, seen] { return stop_ || generation_ != seen; });
+            if (stop_) {
+                return;
+            }
+            seen = generation_;
+        }
+        run_tasks();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            --num_busy_;
+        }
+        done_.notify_one();
+    }
+}
+
+void ThreadPool::run_tasks() {
+    for (size_t i = next_task_++; i < num_tasks_; i = next_task_++) {
+        (*task_)(i);
+    }
+}
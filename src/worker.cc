@@ -1,77 +1,328 @@
 #include <stdexcept>
 #include <cassert>
 #include <iostream>
+#include <algorithm>
+#include <unordered_map>
 
 #include "event.h"
 #include "worker.h"
 #include "aggregator.h"
 #include "utils.h"
+#include "profile.h"
 
 extern uint64_t computation_time;
 extern uint64_t network_time;
 
-Worker::Worker(workernum_t id, uint32_t block_size, uint32_t bf_width) :
+template <typename T>
+Worker<T>::Worker(workernum_t id,
+               uint32_t block_size,
+               uint32_t bf_width,
+               Collective collective,
+               Protocol protocol) :
     id_(id),
     generator_(std::random_device{}()),
+    sparse_(false),
+    sparsified_(false),
+    sparsify_time_(TIME_NOW),
     block_size_(block_size),
     bf_width_(bf_width),
-    recv_packet_(block_size, bf_width),
-    send_packet_(block_size, bf_width) {
+    kernels_(BlockKernels<T>::select(block_size)),
+    collective_(collective),
+    protocol_(protocol),
+    shard_begin_(0),
+    shard_end_(BLOCK_INF),
+    adaptive_width_(false),
+    parallel_threshold_(DEFAULT_PARALLEL_THRESHOLD),
+    send_packet_(block_size, bf_width),
+    round_(0),
+    negotiated_(false),
+    seq_(0),
+    received_(false),
+    loss_probability_(0.0) {
     // Initialize next blocks to first block in each column
     // (0, 1, 2, 3, ...)
     for (uint32_t i = 0; i != bf_width; ++i) {
         next_nonzero_.push_back(i);
         next_agg_.push_back(i);
+        active_.push_back(i);
     }
 }
 
-void Worker::generate_data(size_t size, uint32_t block_size, float sparsity) {
-    if (sparsity < 0.0 || sparsity > 1.0) {
-        throw std::invalid_argument("Sparsity must be between 0 and 1");
-    }
+template <typename T>
+void Worker<T>::seed(uint32_t seed) {
+    generator_.seed(seed);
+}
+
+template <typename T>
+void Worker<T>::generate_data(size_t size, uint32_t block_size, float sparsity) {
+    UniformPattern pattern(sparsity);
+    generate_data(size, block_size, pattern);
+}
+
+template <typename T>
+void Worker<T>::generate_data(size_t size, uint32_t block_size, SparsityPattern& pattern) {
     if (size % block_size != 0) {
         throw std::invalid_argument("Data size must be a multiple of block size");
     }
 
     std::uniform_real_distribution<> distr(0.0, 1.0);
+    sparse_ = false;
+    sparsified_ = false;
     gradients_.resize(size);
-    std::fill(gradients_.begin(), gradients_.end(), 0.0);
+    std::fill(gradients_.begin(), gradients_.end(), T(0));
 
     size_t num_blocks = size / block_size;
+    std::vector<char> nonzero;
+    nonzero.resize(num_blocks);
+    pattern.generate(nonzero, generator_);
     for (size_t i = 0; i != num_blocks; ++i) {
-        bool sparse_block = (distr(generator_) <= sparsity);
-        if (!sparse_block) {
+        if (nonzero[i]) {
             for (uint32_t j = 0; j != block_size; ++j) {
-                gradients_[i * block_size + j] = distr(generator_);
+                gradients_[i * block_size + j] = ElementTraits<T>::from_uniform(distr(generator_));
+            }
+        }
+    }
+}
+
+template <typename T>
+void Worker<T>::set_sparse_data(size_t size,
+                                const std::vector<uint64_t>& indices,
+                                const std::vector<T>& values) {
+    if (indices.size() != values.size()) {
+        throw std::invalid_argument("Sparse data must have one value per index");
+    }
+    ingest(size, indices.size(), [&indices, &values](size_t k) {
+        return std::make_pair(indices[k], values[k]);
+    });
+}
+
+template <typename T>
+void Worker<T>::set_sparse_data(size_t rows,
+                                size_t cols,
+                                const std::vector<uint64_t>& row_ptr,
+                                const std::vector<uint64_t>& col_idx,
+                                const std::vector<T>& values) {
+    if (row_ptr.size() != rows + 1 || row_ptr.front() != 0 ||
+        row_ptr.back() != values.size() || col_idx.size() != values.size()) {
+        throw std::invalid_argument("Malformed CSR data");
+    }
+    // Row of each entry, found by walking the row pointers along with the entries
+    uint64_t row = 0;
+    ingest(rows * cols, values.size(), [&, cols](size_t k) {
+        while (k >= row_ptr[row + 1]) {
+            ++row;
+        }
+        if (col_idx[k] >= cols) {
+            throw std::invalid_argument("CSR column index out of range");
+        }
+        return std::make_pair(row * cols + col_idx[k], values[k]);
+    });
+}
+
+template <typename T>
+template <typename F>
+void Worker<T>::ingest(size_t size, size_t num_entries, F entry) {
+    if (size % block_size_ != 0) {
+        throw std::invalid_argument("Data size must be a multiple of block size");
+    }
+    sparse_ = true;
+    sparsified_ = false;
+    gradients_.assign(size, T(0));
+    sparse_values_.clear();
+
+    // Give each nonzero block a slot in sparse_values_ the first
+    // time one of its entries comes up
+    std::unordered_map<blocknum_t, size_t> offsets;
+    for (size_t k = 0; k != num_entries; ++k) {
+        const std::pair<uint64_t, T> e = entry(k);
+        if (e.first >= size) {
+            throw std::invalid_argument("Sparse index out of range");
+        }
+        const auto slot = offsets.emplace(e.first / block_size_, sparse_values_.size());
+        if (slot.second) {
+            sparse_values_.resize(sparse_values_.size() + block_size_, T(0));
+        }
+        accumulate(&sparse_values_[slot.first->second + e.first % block_size_], &e.second, 1);
+    }
+
+    // Bucket the nonzero blocks into their columns, in block order
+    std::vector<std::pair<blocknum_t, size_t>> blocks(offsets.begin(), offsets.end());
+    std::sort(blocks.begin(), blocks.end());
+    sparse_blocks_.assign(bf_width_, {});
+    sparse_offsets_.assign(bf_width_, {});
+    for (const std::pair<blocknum_t, size_t>& b : blocks) {
+        sparse_blocks_[b.first % bf_width_].push_back(b.first);
+        sparse_offsets_[b.first % bf_width_].push_back(b.second);
+    }
+}
+
+template <typename T>
+void Worker<T>::add_input(double* dst, size_t begin, size_t end) const {
+    if (!sparse_) {
+        for (size_t i = begin; i != end; ++i) {
+            dst[i] += static_cast<double>(gradients_[i]);
+        }
+        return;
+    }
+    for (blocknum_t b = begin / block_size_; b * block_size_ < end; ++b) {
+        const T* block = input_block(b);
+        if (block == nullptr) {
+            continue;
+        }
+        const size_t first = std::max<size_t>(begin, b * block_size_);
+        const size_t last = std::min<size_t>(end, (b + 1) * block_size_);
+        for (size_t i = first; i != last; ++i) {
+            dst[i] += static_cast<double>(block[i - b * block_size_]);
+        }
+    }
+}
+
+template <typename T>
+void Worker<T>::set_shard(blocknum_t begin, blocknum_t end) {
+    if (begin > end) {
+        throw std::invalid_argument("Shard must not end before it begins");
+    }
+    shard_begin_ = begin;
+    shard_end_ = end;
+    if ((collective_ == ALL_GATHER || collective_ == BROADCAST) && sparse_) {
+        for (uint32_t i = 0; i != bf_width_; ++i) {
+            std::vector<blocknum_t> blocks;
+            std::vector<size_t> offsets;
+            for (size_t k = 0; k != sparse_blocks_[i].size(); ++k) {
+                if (owns(sparse_blocks_[i][k])) {
+                    blocks.push_back(sparse_blocks_[i][k]);
+                    offsets.push_back(sparse_offsets_[i][k]);
+                }
+            }
+            sparse_blocks_[i] = std::move(blocks);
+            sparse_offsets_[i] = std::move(offsets);
+        }
+    } else if (collective_ == ALL_GATHER || collective_ == BROADCAST) {
+        const size_t num_blocks = gradients_.size() / block_size_;
+        for (size_t i = 0; i != num_blocks; ++i) {
+            if (!owns(i)) {
+                std::fill(gradients_.begin() + i * block_size_,
+                          gradients_.begin() + (i + 1) * block_size_,
+                          T(0));
             }
         }
     }
-    /*
-    for (size_t i = 0; i != size; ++i) {
-        float num = distr(generator_);
-        // With probability sparsity, the number will be 0,
-        // and randomly between 0 and 1 otherwise
-        if (num <= sparsity) {
-            gradients_[i] = 0;
+}
+
+template <typename T>
+bool Worker<T>::owns(blocknum_t block) const {
+    return block >= shard_begin_ && block < shard_end_;
+}
+
+template <typename T>
+void Worker<T>::set_sparsifier(const Sparsifier& sparsifier) {
+    sparsifier_ = sparsifier;
+    residual_.clear();
+}
+
+template <typename T>
+bool Worker<T>::sparsify() {
+    if (!sparsifier_ || sparsified_) {
+        return false;
+    }
+    if (sparse_) {
+        throw std::logic_error("Sparsification needs dense gradients");
+    }
+    sparsifier_->apply(gradients_, residual_, block_size_);
+    sparsified_ = true;
+    // One pass over the elements to add the residual and rank the blocks,
+    // and one over the blocks to select them
+    sparsify_time_ = static_cast<uint64_t>(ceil(0.64971 * gradients_.size() +
+                                                0.64971 * gradients_.size() / block_size_));
+    return true;
+}
+
+template <typename T>
+timedelta_t Worker<T>::start() {
+    // Every column starts from its first block. With fewer blocks than
+    // columns, the columns past the last block have none to send
+    const size_t num_blocks = gradients_.size() / block_size_;
+    active_.clear();
+    for (uint32_t i = 0; i != bf_width_; ++i) {
+        next_nonzero_[i] = (i < num_blocks) ? i : BLOCK_INF;
+        next_agg_[i] = next_nonzero_[i];
+        active_.push_back(i);
+    }
+    recv_packet_.reset();
+    seq_ = 0;
+    received_ = false;
+    sparsify();
+    timedelta_t delta = sparsify_time_;
+    sparsify_time_ = TIME_NOW;
+
+    if (protocol_ == BITMAP) {
+        schedule_.reset();
+        round_ = 0;
+        negotiated_ = false;
+        // One pass over the blocks to find the nonzero ones
+        bitmap_.assign(num_blocks);
+        if (sparse_) {
+            for (const std::vector<blocknum_t>& blocks : sparse_blocks_) {
+                for (blocknum_t b : blocks) {
+                    bitmap_.set(b);
+                }
+            }
         } else {
-            gradients_[i] = distr(generator_);
+            for (size_t b = 0; b != num_blocks; ++b) {
+                if (!kernels_.is_zero_(&gradients_[b * block_size_], block_size_)) {
+                    bitmap_.set(b);
+                }
+            }
         }
+        delta += static_cast<uint64_t>(ceil(0.64971 * num_blocks));
     }
-    */
+    return delta;
 }
 
-void Worker::recv_packet(const Packet& packet) {
+template <typename T>
+void Worker<T>::recv_packet(const std::shared_ptr<const Packet<T>>& packet) {
+    PROFILE_SCOPE("Worker::recv_packet");
     // Sanity check -- the packet from the aggregator must be multicast
-    debug_assert(packet.worker_id_ == WORKER_ALL);
+    debug_assert(packet->worker_id_ == WORKER_ALL);
     recv_packet_ = packet;
+    received_ = true;
 }
 
-timedelta_t Worker::process_response() {
+template <typename T>
+void Worker<T>::recv_schedule(const std::shared_ptr<const std::vector<blocknum_t>>& schedule) {
+    schedule_ = schedule;
+    received_ = true;
+}
+
+template <typename T>
+void Worker<T>::set_parallel_threshold(size_t threshold) {
+    parallel_threshold_ = threshold;
+}
+
+template <typename T>
+void Worker<T>::set_adaptive_width(bool adaptive) {
+    adaptive_width_ = adaptive;
+}
+
+template <typename T>
+timedelta_t Worker<T>::process_response() {
+    PROFILE_SCOPE("Worker::process_response");
+    ++seq_;
+    received_ = false;
+    if (protocol_ == BITMAP && !negotiated_) {
+        verbose_print("[W" << id_
+            << "] Received schedule of " << schedule_->size() << " blocks" << std::endl;);
+        negotiated_ = true;
+        return scheduled_prepare_time();
+    }
     verbose_print("[W" << id_
         << "] Processing packet from aggregator" << std::endl;);
 
-    for (uint32_t i = 0; i != bf_width_; ++i) {
-        Block& recv_block = recv_packet_.blocks_[i];
+    // Columns of the received packet
+    const size_t num_columns = adaptive_width_ ? active_.size() : bf_width_;
+    copied_.clear();
+    for (uint32_t i : active_) {
+        const Block<T>& recv_block = recv_packet_->blocks_[i];
         verbose_print("     Processing block ID "
             << (recv_block.is_valid() ? std::to_string(recv_block.block_id_) : "INF")
             << ", next requested block ID "
@@ -82,30 +333,62 @@ timedelta_t Worker::process_response() {
         );
         // Skip invalid blocks == blocks that were not sent by the aggregator
         if (!recv_block.is_valid()) {
-            // If a block was not sent by the aggregator, then
-            // the next requested block also must be invalid, and there
-            // must be no valid blocks in this column anymore
-            debug_assert(!recv_block.is_next_valid());
-            debug_assert(next_nonzero_[i] == BLOCK_INF);
+            // If the aggregator had no slots for the column, it requests
+            // the rejected block again, and the workers that sent it send
+            // it again
+            if (recv_block.is_next_valid()) {
+                next_agg_[i] = recv_block.next_;
+                if (send_packet_.blocks_[i].block_id_ == recv_block.next_) {
+                    next_nonzero_[i] = recv_block.next_;
+                }
+                continue;
+            }
+            // Otherwise, there must be no valid blocks in this column anymore
+            debug_assert(protocol_ == BITMAP || next_nonzero_[i] == BLOCK_INF);
             continue;
         }
         debug_assert(recv_block.data_.size() == block_size_);
 
-        // Copy gradients for each block in the fused packet
-        for (size_t j = 0; j != recv_block.data_.size(); ++j) {
-            gradients_[recv_block.block_id_ * block_size_ + j] = recv_block.data_[j];
-        }   
+        // Copy gradients for each block in the fused packet. With reduce-scatter,
+        // the aggregator delivers the payload of owned blocks only
+        if (collective_ != REDUCE_SCATTER || owns(recv_block.block_id_)) {
+            copied_.push_back(i);
+        }
 
         // Update the blocks requested by the aggregator
         next_agg_[i] = recv_block.next_;
     }
+    // The blocks of different columns are copied in parallel
+    parallel_for_work(copied_.size(), block_size_, parallel_threshold_, [this](size_t k) {
+        const Block<T>& recv_block = recv_packet_->blocks_[copied_[k]];
+        kernels_.copy_(&gradients_[recv_block.block_id_ * block_size_],
+                       recv_block.data_.data(),
+                       block_size_);
+    });
+    // Release the shared packet, so that the aggregator can reuse it
+    recv_packet_.reset();
+    if (protocol_ == BITMAP) {
+        return scheduled_prepare_time();
+    }
+
+    // Drop the columns that the aggregator requests no more blocks in.
+    // The last block sent in such a column must not be sent again
+    auto dry = std::remove_if(active_.begin(), active_.end(), [this](uint32_t i) {
+        if (next_agg_[i] != BLOCK_INF) {
+            return false;
+        }
+        send_packet_.blocks_[i].invalidate();
+        send_packet_.blocks_[i].next_ = BLOCK_INF;
+        return true;
+    });
+    active_.erase(dry, active_.end());
 
     float total_time = 0;
     std::vector<blocknum_t> next_nonzero = find_nonzero();
     debug_assert(next_nonzero.size() == bf_width_);
 
-    total_time += 0.64971 * bf_width_;
-    for (uint32_t i = 0; i != bf_width_; ++i) {
+    total_time += 0.64971 * num_columns;
+    for (uint32_t i : active_) {
         // Skip if there is no next non-zero block or if the block requested by the
         // aggregator is different
         if (next_nonzero_[i] == BLOCK_INF || next_agg_[i] != next_nonzero_[i]) {
@@ -124,9 +407,15 @@ timedelta_t Worker::process_response() {
     return static_cast<uint64_t>(ceil(total_time));
 }
 
-timedelta_t Worker::prepare_to_send() {
-    for (uint32_t i = 0; i != bf_width_; ++i) {
-        Block& block = send_packet_.blocks_[i];
+template <typename T>
+timedelta_t Worker<T>::prepare_to_send() {
+    PROFILE_SCOPE("Worker::prepare_to_send");
+    if (protocol_ == BITMAP) {
+        return prepare_scheduled();
+    }
+    copied_.clear();
+    for (uint32_t i : active_) {
+        Block<T>& block = send_packet_.blocks_[i];
         // If there are no nonzero blocks left in the column, or the aggregator
         // requested a different, smaller block ID, then invalidate and skip this block
         if (next_nonzero_[i] == BLOCK_INF || next_agg_[i] != next_nonzero_[i]) {
@@ -136,16 +425,25 @@ timedelta_t Worker::prepare_to_send() {
         block.block_id_ = next_agg_[i];
         // Sanity check -- the block ID must correspond to this column in the packet
         debug_assert(block.block_id_ % bf_width_ == i);
-        // Copy the gradients
-        for (size_t j = 0; j != block_size_; ++j) {
-            block.data_[j] = gradients_[next_agg_[i] * block_size_ + j];
-        }
+        copied_.push_back(i);
     }
+    // Copy the gradients, the blocks of different columns in parallel
+    parallel_for_work(copied_.size(), block_size_, parallel_threshold_, [this](size_t k) {
+        Block<T>& block = send_packet_.blocks_[copied_[k]];
+        const T* input = input_block(block.block_id_);
+        if (input != nullptr) {
+            kernels_.copy_(block.data_.data(), input, block_size_);
+        } else {
+            // Only the first block of a column can be requested without
+            // being nonzero
+            std::fill(block.data_.begin(), block.data_.end(), T(0));
+        }
+    });
     send_packet_.worker_id_ = id_;
 
     // Find the next non-zero block for each block in the fused packet
     next_nonzero_ = find_nonzero();
-    for (uint32_t i = 0; i != bf_width_; ++i) {
+    for (uint32_t i : active_) {
         send_packet_.blocks_[i].next_ = next_nonzero_[i];
     }
 
@@ -154,7 +452,7 @@ timedelta_t Worker::prepare_to_send() {
         << std::endl);
     // Verbose output, this loop is optimized out otherwise
     for (uint32_t i = 0; i != bf_width_; ++i) {
-        Block& send_block = send_packet_.blocks_[i];
+        Block<T>& send_block = send_packet_.blocks_[i];
         // Silence compiler warnings when verbose mode is turned off
         (void) send_block;
         verbose_print("     Block ID "
@@ -165,7 +463,7 @@ timedelta_t Worker::prepare_to_send() {
     }
 
     uint32_t valid_blocks = 0;
-    for (uint32_t i = 0; i != bf_width_; ++i) {
+    for (uint32_t i : active_) {
         valid_blocks += send_packet_.blocks_[i].is_valid();
     }
     // If there are no valid blocks in the packet, the worker does not
@@ -175,53 +473,210 @@ timedelta_t Worker::prepare_to_send() {
     }
     // Otherwise, the worker sends only the valid blocks
     //network_time += static_cast<uint64_t>(ceil(1000 + 0.08 * block_size_ * valid_blocks));
-    return static_cast<uint64_t>(ceil(1000 + 0.8 * block_size_ * valid_blocks));
+    return static_cast<uint64_t>(ceil(LINK_LATENCY + wire_time<T>(block_size_, valid_blocks)));
 }
 
-timedelta_t Worker::send(Aggregator& agg) {
+template <typename T>
+timedelta_t Worker<T>::send(Aggregator<T>& agg) {
+    PROFILE_SCOPE("Worker::send");
+    if (protocol_ == BITMAP && !negotiated_) {
+        verbose_print("[W" << id_
+              << "] Sent bitmap to aggregator"
+              << std::endl);
+        agg.recv_bitmap(id_, bitmap_);
+        // ORing the bitmap into the union
+        return static_cast<uint64_t>(ceil(0.64971 * bitmap_.num_words()));
+    }
     verbose_print("[W" << id_
           << "] Sent packet to aggregator"
           << std::endl);
     agg.recv_packet(send_packet_);
     uint32_t valid_blocks = 0;
-    for (uint32_t i = 0; i != bf_width_; ++i) {
+    for (uint32_t i : active_) {
         valid_blocks += send_packet_.blocks_[i].is_valid();
     }
+    const size_t num_columns = adaptive_width_ ? active_.size() : bf_width_;
     // Processing the packet will take iterating over each fused block,
     // and then over data for valid blocks
     //computation_time += static_cast<uint64_t>(ceil(0.64971 * bf_width_ + 0.64971 * valid_blocks * block_size_));
-    return static_cast<uint64_t>(ceil(0.64971 * bf_width_ + 0.64971 * valid_blocks * block_size_));
+    return static_cast<uint64_t>(ceil(0.64971 * num_columns + 0.64971 * valid_blocks * block_size_));
+}
+
+template <typename T>
+void Worker<T>::set_loss(double probability, uint32_t seed) {
+    if (probability < 0.0 || probability >= 1.0) {
+        throw std::invalid_argument("Loss probability must be in [0, 1)");
+    }
+    loss_probability_ = probability;
+    std::seed_seq seq{seed, id_};
+    uint32_t seeds[2];
+    seq.generate(seeds, seeds + 2);
+    uplink_generator_.seed(seeds[0]);
+    downlink_generator_.seed(seeds[1]);
+}
+
+template <typename T>
+bool Worker<T>::uplink_lost() {
+    std::uniform_real_distribution<> distr(0.0, 1.0);
+    return distr(uplink_generator_) < loss_probability_;
+}
+
+template <typename T>
+bool Worker<T>::downlink_lost() {
+    std::uniform_real_distribution<> distr(0.0, 1.0);
+    return distr(downlink_generator_) < loss_probability_;
+}
+
+template <typename T>
+uint64_t Worker<T>::get_seq() const {
+    return seq_;
+}
+
+template <typename T>
+bool Worker<T>::waiting(uint64_t seq) const {
+    return seq == seq_ && !received_;
+}
+
+template <typename T>
+bool Worker<T>::finished() const {
+    if (protocol_ == BITMAP) {
+        // The schedule, and then one result per round
+        return negotiated_ && (seq_ - 1) * bf_width_ >= schedule_->size();
+    }
+    // The aggregator requests no more blocks after the last round
+    return seq_ != 0 && active_.empty();
+}
+
+template <typename T>
+bool Worker<T>::has_payload() const {
+    if (protocol_ == BITMAP && !negotiated_) {
+        return true;
+    }
+    for (uint32_t i : active_) {
+        if (send_packet_.blocks_[i].is_valid()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+template <typename T>
+timedelta_t Worker<T>::resend_time() const {
+    if (protocol_ == BITMAP && !negotiated_) {
+        return static_cast<uint64_t>(ceil(LINK_LATENCY + wire_time_bytes(bitmap_.compressed_bytes())));
+    }
+    uint32_t valid_blocks = 0;
+    for (uint32_t i : active_) {
+        valid_blocks += send_packet_.blocks_[i].is_valid();
+    }
+    return static_cast<uint64_t>(ceil(LINK_LATENCY + wire_time<T>(block_size_, valid_blocks)));
+}
+
+template <typename T>
+timedelta_t Worker<T>::prepare_scheduled() {
+    if (!negotiated_) {
+        // The first packet only carries the bitmap
+        verbose_print("[W" << id_
+            << "] Prepared to send bitmap of " << bitmap_.count()
+            << " blocks to aggregator" << std::endl);
+        return static_cast<uint64_t>(ceil(LINK_LATENCY + wire_time_bytes(bitmap_.compressed_bytes())));
+    }
+    // Send this worker's blocks among the blocks of the round
+    copied_.clear();
+    for (uint32_t i = 0; i != bf_width_; ++i) {
+        Block<T>& block = send_packet_.blocks_[i];
+        block.next_ = BLOCK_INF;
+        const size_t k = round_ * bf_width_ + i;
+        if (k >= schedule_->size() || !bitmap_.test((*schedule_)[k])) {
+            block.invalidate();
+            continue;
+        }
+        block.block_id_ = (*schedule_)[k];
+        copied_.push_back(i);
+    }
+    parallel_for_work(copied_.size(), block_size_, parallel_threshold_, [this](size_t k) {
+        Block<T>& block = send_packet_.blocks_[copied_[k]];
+        kernels_.copy_(block.data_.data(), input_block(block.block_id_), block_size_);
+    });
+    const uint32_t valid_blocks = copied_.size();
+    send_packet_.worker_id_ = id_;
+    ++round_;
+
+    verbose_print("[W" << id_
+        << "] Prepared to send " << valid_blocks
+        << " blocks of round " << round_ - 1 << " to aggregator" << std::endl);
+    if (valid_blocks == 0) {
+        return 0;
+    }
+    return static_cast<uint64_t>(ceil(LINK_LATENCY + wire_time<T>(block_size_, valid_blocks)));
 }
 
-std::vector<blocknum_t> Worker::find_nonzero() const {
+template <typename T>
+timedelta_t Worker<T>::scheduled_prepare_time() const {
+    uint32_t own_blocks = 0;
+    for (uint32_t i = 0; i != bf_width_; ++i) {
+        const size_t k = round_ * bf_width_ + i;
+        own_blocks += k < schedule_->size() && bitmap_.test((*schedule_)[k]);
+    }
+    return static_cast<uint64_t>(ceil(0.64971 * bf_width_ + 0.64971 * own_blocks * block_size_));
+}
+
+template <typename T>
+const Buffer<T>& Worker<T>::gradients() const {
+    return gradients_;
+}
+
+template <typename T>
+std::vector<blocknum_t> Worker<T>::find_nonzero() const {
+    PROFILE_SCOPE("Worker::find_nonzero");
     std::vector<blocknum_t> next_nonzero;
     next_nonzero.resize(bf_width_);
     std::fill(next_nonzero.begin(), next_nonzero.end(), BLOCK_INF);
 
-    for (uint32_t i = 0; i != bf_width_; ++i) {
+    // Columns are searched in parallel, each checks at least one block
+    parallel_for_work(active_.size(), block_size_, parallel_threshold_, [this, &next_nonzero](size_t k) {
+        const uint32_t i = active_[k];
         // For columns for which the aggregator requested INF,
         // there are no more nonzero blocks
         if (next_agg_[i] == BLOCK_INF) {
-            continue;
+            return;
+        }
+        // With sparse input, the nonzero blocks of the column are listed
+        if (sparse_) {
+            const std::vector<blocknum_t>& blocks = sparse_blocks_[i];
+            auto next = std::upper_bound(blocks.begin(), blocks.end(), next_agg_[i]);
+            if (next != blocks.end()) {
+                next_nonzero[i] = *next;
+            }
+            return;
         }
         // Iterate through blocks in the column until one with all zeros is found
         for (blocknum_t j = next_agg_[i] + bf_width_;
              j * block_size_ < gradients_.size();
              j += bf_width_) {
-            bool zero_block = true;
-            for (size_t k = 0;
-                 k != block_size_ && j * block_size_ + k < gradients_.size();
-                 ++k) {
-                if (gradients_[j * block_size_ + k] != 0) {
-                    zero_block = false;
-                    break;
-                }
-            }
-            if (!zero_block) {
+            if (!kernels_.is_zero_(&gradients_[j * block_size_], block_size_)) {
                 next_nonzero[i] = j;
                 break;
             }
         }
-    }
+    });
     return next_nonzero;
 }
+
+template <typename T>
+const T* Worker<T>::input_block(blocknum_t block) const {
+    if (!sparse_) {
+        return &gradients_[block * block_size_];
+    }
+    const std::vector<blocknum_t>& blocks = sparse_blocks_[block % bf_width_];
+    auto it = std::lower_bound(blocks.begin(), blocks.end(), block);
+    if (it == blocks.end() || *it != block) {
+        return nullptr;
+    }
+    return &sparse_values_[sparse_offsets_[block % bf_width_][it - blocks.begin()]];
+}
+
+template class Worker<float>;
+template class Worker<double>;
+template class Worker<bf16>;
+template class Worker<int32_t>;